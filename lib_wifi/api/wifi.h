@@ -2,16 +2,260 @@
 #ifndef __wifi_h__
 #define __wifi_h__
 
+#include <stdint.h>
+
 #ifndef WIFI_MAX_SCAN_RESULTS
-/** TODO: document */
+/** Number of networks kept from a scan. Networks are found by a hash of
+ *  their BSSID and channel, so this can be made much larger. When the table
+ *  is full a newly found network takes the index of the one with the weakest
+ *  signal if its own signal is stronger. No other network changes index.
+ */
 #define WIFI_MAX_SCAN_RESULTS 50
 #endif
 
+#ifndef WIFI_SCAN_HASH_BUCKETS
+/** Number of hash buckets used to find scan results. A power of two, and
+ *  best kept above WIFI_MAX_SCAN_RESULTS when that is raised.
+ */
+#define WIFI_SCAN_HASH_BUCKETS 64
+#endif
+
+#ifndef WIFI_SCAN_MAX_AGE_MS
+/** Networks are kept in the scan table across scans. One not heard for this
+ *  long is replaced first when the table is full, and join_network_by_name()
+ *  probes for a network rather than join one not heard in this time.
+ */
+#define WIFI_SCAN_MAX_AGE_MS 60000
+#endif
+
+#ifndef WIFI_FIRMWARE_READ_AHEAD
+/** Bytes of the firmware file read from the filesystem at a time. A multiple
+ *  of the filesystem sector size is best. The buffer is on the driver's stack
+ *  while init_radio() downloads the firmware.
+ */
+#define WIFI_FIRMWARE_READ_AHEAD 2048
+#endif
+
+/** The WLAN firmware image, which the application must define when lib_wifi
+ *  is built with WWD_DIRECT_RESOURCES = 1. WWD then downloads it from memory
+ *  rather than from the filesystem. create_wifi_firmware_source.py writes a
+ *  C file defining both from a firmware image.
+ */
+extern const uint8_t wifi_firmware_image[];
+extern const uint32_t wifi_firmware_image_size; ///< Bytes in the image
+
+#ifndef WIFI_PROFILE_FILENAME
+/** File holding the SSID, BSSID, channel, band and security of the network
+ *  last joined, so that it can be rejoined without scanning. It must already
+ *  exist in the filesystem given to wifi_broadcom_wiced_builtin_spi() with
+ *  at least 64 bytes. The security key is not saved.
+ */
+#define WIFI_PROFILE_FILENAME "WIFI.PRF"
+#endif
+
+#ifndef WIFI_LINK_CHECK_PERIOD_MS
+/** How often to check the link to a joined network, which is rejoined with
+ *  the same key when lost: first directly on its saved BSSID and channel,
+ *  then from a background scan if that fails. 0 disables the check.
+ */
+#define WIFI_LINK_CHECK_PERIOD_MS 1000
+#endif
+
+#ifndef WIFI_LINK_REJOIN_MAX_BACKOFF_MS
+/** Longest wait before scanning again after failing to rejoin a lost link.
+ *  The wait starts at WIFI_LINK_CHECK_PERIOD_MS and doubles with each failure.
+ *  At most 20000.
+ */
+#define WIFI_LINK_REJOIN_MAX_BACKOFF_MS 16000
+#endif
+
 #ifndef WIFI_MAX_KEY_LENGTH
 /** TODO: document */
 #define WIFI_MAX_KEY_LENGTH 50
 #endif
 
+/** What to do with a received packet when the RX ring is full */
+#define WIFI_RX_DROP_NEWEST  0 ///< Free the packet that has just arrived
+#define WIFI_RX_DROP_OLDEST  1 ///< Free the oldest queued packet
+#define WIFI_RX_STOP_READING 2 ///< Stop reading the bus until there is space
+
+#ifndef WIFI_RX_RING_DEPTH
+/** Number of received packets that can be queued waiting for the client of
+ *  the xtcp_pbuf_if to take them
+ */
+#define WIFI_RX_RING_DEPTH 10
+#endif
+
+#ifndef WIFI_RX_OVERFLOW_POLICY
+/** The policy applied when the RX ring is full. Control responses share the
+ *  bus with packets, so with WIFI_RX_STOP_READING the bus is still read while
+ *  a control request is in progress and packets that do not fit are dropped.
+ */
+#define WIFI_RX_OVERFLOW_POLICY WIFI_RX_DROP_NEWEST
+#endif
+
+#ifndef WIFI_RX_BULK_MAX
+/** Maximum number of packets handed over by each receive_packet() call on the
+ *  xtcp_pbuf_if. Bulk handover is off by default: each call hands over a
+ *  single packet, so there is one interface transaction per packet. Above 1
+ *  the packets are returned as an lwIP packet queue: the last pbuf of each
+ *  packet links to the first pbuf of the next one, and each packet's tot_len
+ *  covers only that packet. Raise it, to 8 say, to save the per-packet
+ *  transactions when the client walks the queue, as xtcp_lwip_wifi() does.
+ *  receive_packet() returns NULL when no packet is left.
+ */
+#define WIFI_RX_BULK_MAX 1
+#endif
+
+#ifndef WIFI_TX_QUEUE_DEPTH
+/** Maximum number of packets passed to the WWD driver that it has not yet
+ *  sent. Packets wait here while the WLAN has no SDPCM credits, so this
+ *  bounds the memory and latency of the TX path.
+ */
+#define WIFI_TX_QUEUE_DEPTH 8
+#endif
+
+#ifndef WIFI_BUFFER_SMALL_SIZE
+/** Size in bytes of the small class of WWD buffers, used for SDPCM credit
+ *  updates, control requests and short events. Larger buffers hold
+ *  WICED_LINK_MTU bytes.
+ */
+#define WIFI_BUFFER_SMALL_SIZE 128
+#endif
+
+/* Number of WWD buffers of each size class in each partition. Packets read
+ * from the bus use the RX partition, requests to the WLAN use the TX
+ * partition and the control partition is kept back so that control responses
+ * and events can still be read while all of the RX buffers are queued for the
+ * client. Data packets read into control buffers are dropped. Each count must
+ * be at least one.
+ */
+#ifndef WIFI_BUFFERS_RX_SMALL
+#define WIFI_BUFFERS_RX_SMALL 4
+#endif
+
+#ifndef WIFI_BUFFERS_RX_HELD
+/** Number of received packets the client may keep hold of after taking them,
+ *  e.g. while lwIP reassembles a datagram or replies to a packet. The RX
+ *  partition has this many large buffers more than the RX ring so that
+ *  reading can carry on while the ring is full.
+ */
+#define WIFI_BUFFERS_RX_HELD 4
+#endif
+
+#ifndef WIFI_BUFFERS_RX_LARGE
+#define WIFI_BUFFERS_RX_LARGE (WIFI_RX_RING_DEPTH + WIFI_BUFFERS_RX_HELD)
+#endif
+
+#ifndef WIFI_BUFFERS_TX_SMALL
+#define WIFI_BUFFERS_TX_SMALL 2
+#endif
+
+#ifndef WIFI_BUFFERS_TX_LARGE
+#define WIFI_BUFFERS_TX_LARGE 1
+#endif
+
+#ifndef WIFI_BUFFERS_CONTROL_SMALL
+#define WIFI_BUFFERS_CONTROL_SMALL 2
+#endif
+
+#ifndef WIFI_BUFFERS_CONTROL_LARGE
+#define WIFI_BUFFERS_CONTROL_LARGE 2
+#endif
+
+/** Counters for the ring of received packets */
+typedef struct wifi_rx_ring_stats_t {
+  unsigned depth;           ///< Number of packets the ring can hold
+  unsigned count;           ///< Number of packets currently queued
+  unsigned high_water_mark; ///< Largest number of packets queued at once
+  unsigned dropped;         ///< Packets freed because the ring was full
+  unsigned paused;          ///< Times bus reads were stopped by a full ring
+} wifi_rx_ring_stats_t;
+
+#ifndef WIFI_LATENCY_BINS
+/** Number of bins in each latency histogram */
+#define WIFI_LATENCY_BINS 8
+#endif
+
+#ifndef WIFI_LATENCY_BIN_US
+/** Upper limit of the first latency histogram bin in microseconds. Each
+ *  following bin has twice the limit of the one before, and the last bin
+ *  counts everything above the limit of the bin before it.
+ */
+#define WIFI_LATENCY_BIN_US 50
+#endif
+
+/** Driver statistics, counted since start up or the last reset_stats() */
+typedef struct wifi_stats_t {
+  unsigned rx_frames;           ///< Packets received from the WLAN
+  unsigned rx_bytes;
+  unsigned tx_frames;           ///< Packets queued to be sent to the WLAN
+  unsigned tx_bytes;
+  unsigned rx_ring_drops;       ///< Received packets dropped by a full RX ring
+  unsigned tx_queue_drops;      ///< Packets dropped by a full TX queue
+  unsigned pbuf_alloc_failures; ///< Failed host_buffer_get() calls and
+                                ///< packets dropped from control buffers
+  unsigned spi_transactions;
+  unsigned spi_bytes;
+  unsigned credit_stalls;       ///< Times the WLAN ran out of SDPCM credits
+  unsigned bus_pokes;           ///< Pokes of the WLAN to get more credits
+  unsigned bus_sleeps;          ///< Times the bus was allowed to sleep
+  unsigned bus_wakes;           ///< Transfers that found the bus asleep
+  unsigned poll_mode_entries;   ///< Switches from interrupts to polling
+  unsigned polls;               ///< Polls of the bus while polling
+  unsigned firmware_load_us;    ///< Time from opening the firmware file to
+                                ///< reading the end of it
+  unsigned firmware_fs_reads;   ///< Filesystem reads of the firmware file
+
+  /** Time from the WLAN interrupt, or the start of a read of the bus, to the
+   *  packet being taken by the client
+   */
+  unsigned irq_to_delivery[WIFI_LATENCY_BINS];
+
+  /** Time from send_packet() to the packet having been written to the bus */
+  unsigned send_to_wire[WIFI_LATENCY_BINS];
+} wifi_stats_t;
+
+/** State of the WLAN chipset and the bus to it */
+typedef struct wifi_hardware_status_t {
+  unsigned radio_initialised; ///< init_radio() has completed
+  unsigned link_up;           ///< Joined to a network and able to send
+  unsigned bus_asleep;        ///< The bus is asleep until the next transfer
+  unsigned credit_stalled;    ///< The WLAN has run out of SDPCM credits
+  unsigned rx_paused;         ///< Reading packets from the bus is stopped
+  unsigned tx_queued;         ///< Packets waiting for the WWD driver to send
+} wifi_hardware_status_t;
+
+/** Progress of a network scan */
+typedef enum {
+  WIFI_SCAN_IDLE,     ///< No scan has been started
+  WIFI_SCAN_RUNNING,  ///< Results are still arriving
+  WIFI_SCAN_COMPLETE, ///< The scan has finished
+  WIFI_SCAN_ABORTED   ///< The scan was stopped before it finished
+} wifi_scan_state_t;
+
+/** Maximum length of an SSID in bytes */
+#define WIFI_SSID_MAX_LENGTH 32
+
+/** A network found by a scan */
+typedef struct wifi_network_info_t {
+  uint8_t ssid[WIFI_SSID_MAX_LENGTH];
+  unsigned ssid_length;
+  uint8_t bssid[6];
+  int signal_strength;    ///< RSSI in dBm
+  unsigned channel;
+  unsigned security;      ///< wiced_security_t
+  unsigned bss_type;      ///< wiced_bss_type_t
+  unsigned max_data_rate; ///< kbit/s
+  unsigned last_seen;     ///< host_rtos_get_time() in ms when last heard
+} wifi_network_info_t;
+
+/** Returns non-zero while WIFI_TX_QUEUE_DEPTH packets are waiting to be sent.
+ *  Further packets passed to send_packet() on the xtcp_pbuf_if are dropped,
+ *  so xtcp_lwip_wifi() stops servicing its xtcp clients until it clears.
+ */
+int wifi_tx_queue_full();
+
 #ifdef __XC__
 
 #include <xs1.h>
@@ -29,6 +273,52 @@ typedef enum {
   WIFI_ERROR    ///< TODO: document
 } wifi_res_t;
 
+/** When the bus to the WLAN chipset is allowed to sleep. The WLAN must be
+ *  woken with a handshake over the bus before the next frame after a sleep.
+ */
+typedef enum {
+  WIFI_BUS_ALWAYS_AWAKE,      ///< Never sleep, for the lowest latency
+  WIFI_BUS_SLEEP_WHEN_IDLE,   ///< Sleep once the bus has been idle a while
+  WIFI_BUS_SLEEP_IMMEDIATELY  ///< Sleep after every burst of frames
+} wifi_bus_power_policy_t;
+
+#ifndef WIFI_BUS_POWER_POLICY
+/** The bus power policy until set_chipset_power_mode() is called */
+#define WIFI_BUS_POWER_POLICY WIFI_BUS_SLEEP_IMMEDIATELY
+#endif
+
+#ifndef WIFI_BUS_IDLE_TIMEOUT_MS
+/** Idle time before the bus sleeps with WIFI_BUS_SLEEP_WHEN_IDLE until
+ *  set_chipset_power_mode() is called
+ */
+#define WIFI_BUS_IDLE_TIMEOUT_MS 10
+#endif
+
+#ifndef WIFI_POLL_ENTER_IRQS
+/** WLAN interrupts in a row, each within WIFI_POLL_ENTER_GAP_US of the last,
+ *  that switch the WWD thread from waiting for interrupts to polling the bus.
+ *  0 disables polling.
+ */
+#define WIFI_POLL_ENTER_IRQS 8
+#endif
+
+#ifndef WIFI_POLL_ENTER_GAP_US
+/** Longest gap between interrupts that counts towards WIFI_POLL_ENTER_IRQS */
+#define WIFI_POLL_ENTER_GAP_US 500
+#endif
+
+#ifndef WIFI_POLL_INTERVAL_US
+/** Time between polls of the bus while polling */
+#define WIFI_POLL_INTERVAL_US 20
+#endif
+
+#ifndef WIFI_POLL_EXIT_IDLE_POLLS
+/** Polls in a row that find no frames before the WWD thread goes back to
+ *  waiting for interrupts
+ */
+#define WIFI_POLL_EXIT_IDLE_POLLS 50
+#endif
+
 /** Module HAL - similar to smi.h?
  * TODO: document
  */
@@ -37,14 +327,21 @@ typedef interface wifi_hal_if {
   /** TODO: document */
   void init_radio();
 
-  /** TODO: document */
-  void get_hardware_status();
+  /** Get the state of the WLAN chipset and the bus to it */
+  wifi_hardware_status_t get_hardware_status();
 
-  /** TODO: document */
-  void get_chipset_power_mode();
+  /** Get the bus power policy and the idle time used by
+   *  WIFI_BUS_SLEEP_WHEN_IDLE
+   */
+  wifi_bus_power_policy_t get_chipset_power_mode(unsigned &idle_timeout_ms);
 
-  /** TODO: document */
-  void set_chipset_power_mode(); // required?
+  /** Set when the bus to the WLAN chipset is allowed to sleep. idle_timeout_ms
+   *  is the time without frames before it sleeps with
+   *  WIFI_BUS_SLEEP_WHEN_IDLE. The WLAN may still be kept awake while WWD
+   *  needs it. Wakes and sleeps are counted in wifi_stats_t.
+   */
+  void set_chipset_power_mode(wifi_bus_power_policy_t policy,
+                              unsigned idle_timeout_ms);
 
   /** TODO: document */
   void get_radio_tx_power();
@@ -67,6 +364,15 @@ typedef interface wifi_hal_if {
   /** TODO: document */
   void set_channel(); // move to wifi_network_config_if?
 
+  /** Get the counters for the ring of received packets */
+  wifi_rx_ring_stats_t get_rx_ring_stats();
+
+  /** Get the driver statistics */
+  wifi_stats_t get_stats();
+
+  /** Zero the driver statistics */
+  void reset_stats();
+
 } wifi_hal_if;
 
 /** WiFi/application configuration interface - ethernet.h equivalent
@@ -90,10 +396,46 @@ typedef interface wifi_network_config_if {
   void set_networking_mode(); // AP, AD Hoc, client, etc.
 
   // Client mode functions
-  /** TODO: document */
+  /** Scan for networks, returning the number found once the scan has
+   *  finished. No other requests or packets are handled during the scan, so
+   *  start_scan() is preferred.
+   */
   size_t scan_for_networks();
 
-  /** TODO: document */
+  /** Start a scan for networks and return immediately. The client is then
+   *  notified with scan_event() as results arrive and when each scan ends.
+   *  Returns WIFI_ERROR if a scan is already running.
+   */
+  wifi_res_t start_scan();
+
+  /** Scan for networks in the background every period_ms, or stop if 0.
+   *  The client is notified of the results as for start_scan(), and stops
+   *  being notified when it sets the period to 0.
+   */
+  void set_scan_period(unsigned period_ms);
+
+  /** Notification that there are new scan results or a scan has ended */
+  [[notification]] slave void scan_event();
+
+  /** Get the progress of the current or last scan and the number of results
+   *  in the table
+   */
+  [[clears_notification]] wifi_scan_state_t get_scan_state(size_t &num_results);
+
+  /** Get a result from the scan table. Returns WIFI_ERROR if index is not
+   *  less than the number of results.
+   */
+  wifi_res_t get_scan_result(size_t index, wifi_network_info_t &info);
+
+  /** Join a network by its SSID. The access point in WIFI_PROFILE_FILENAME
+   *  is tried first, directly on its BSSID and channel. Failing that,
+   *  the strongest access point heard by a scan or probe within
+   *  WIFI_SCAN_MAX_AGE_MS is joined on its BSSID and channel without
+   *  scanning, otherwise a probe is sent for the SSID first. Returns a
+   *  wwd_result_t, which is WWD_NETWORK_NOT_FOUND if nothing answered the
+   *  probe. A background scan still running is aborted rather than waited
+   *  for, so its clients see it end as WIFI_SCAN_ABORTED.
+   */
   unsigned join_network_by_name(char name[SSID_NAME_SIZE], uint8_t security_key[key_length],
                         size_t key_length);
 
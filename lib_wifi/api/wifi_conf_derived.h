@@ -6,4 +6,7 @@
 
 #define PBUF_LINK_ENCAPSULATION_HLEN (WICED_PHYSICAL_HEADER)
 
+// WWD buffers are lwIP custom pbufs returned to the driver's own partitions
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+
 #endif // __wifi_conf_derived_h__
@@ -5,6 +5,51 @@
 #include <xs1.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <xccompat.h>
+#include "xc2compat.h"
+
+typedef enum wifi_spi_direction_t {
+  WIFI_SPI_READ,
+  WIFI_SPI_WRITE,
+  WIFI_SPI_READ_WRITE
+} wifi_spi_direction_t;
+
+/** One contiguous piece of a scatter-gather SPI transfer. Data is always
+ *  clocked out of the segment; received data is only stored back into it if
+ *  the direction is not WIFI_SPI_WRITE.
+ */
+typedef struct {
+  uint8_t * unsafe data;
+  unsigned length;
+  wifi_spi_direction_t direction;
+} wifi_spi_segment_t;
+
+/** Enough for a TX buffer chain of up to 16 pieces and the status read */
+#ifndef WIFI_SPI_BATCH_MAX_SEGMENTS
+#define WIFI_SPI_BATCH_MAX_SEGMENTS 17
+#endif
+
+/** A bus transaction built up from a command, its payload and any follow-on
+ *  reads such as a status word, all transferred under one CS assertion.
+ */
+typedef struct {
+  wifi_spi_segment_t segments[WIFI_SPI_BATCH_MAX_SEGMENTS];
+  unsigned num_segments;
+} wifi_spi_batch_t;
+
+/** Empty a batch ready for segments to be queued */
+void wifi_spi_batch_init(REFERENCE_PARAM(wifi_spi_batch_t, batch));
+
+/** Queue a segment at the end of a batch.
+ *
+ *  \returns 1 if the segment was queued, 0 if the batch is full
+ */
+int wifi_spi_batch_add(REFERENCE_PARAM(wifi_spi_batch_t, batch),
+                       uint8_t * unsafe data,
+                       unsigned length,
+                       wifi_spi_direction_t direction);
+
+#ifdef __XC__
 
 typedef struct {
   out buffered port:32 clk;
@@ -16,6 +61,11 @@ typedef struct {
   unsigned clock_divide;
   unsigned cs_to_data_delay_ns;
   unsigned cs_to_data_delay_ticks;
+  unsigned cs_hold_ns; // CS held asserted after the last data bit
+  unsigned cs_hold_ticks;
+  unsigned cs_idle_ns; // Minimum time CS is deasserted between transfers
+  unsigned cs_idle_end_time;
+  unsigned configured; // Set once the ports are configured for clock_divide
 } wifi_spi_ports;
 
 typedef enum wifi_spi_port_time_mode_t {
@@ -24,17 +74,54 @@ typedef enum wifi_spi_port_time_mode_t {
   WIFI_SPI_CS_GET_TIMESTAMP
 } wifi_spi_port_time_mode_t;
 
-typedef enum wifi_spi_direction_t {
-  WIFI_SPI_READ,
-  WIFI_SPI_WRITE,
-  WIFI_SPI_READ_WRITE
-} wifi_spi_direction_t;
-
 void wifi_spi_init(wifi_spi_ports &p);
 
+// Configures the ports only if they have not been configured since the last
+// wifi_spi_deinit()
+void wifi_spi_ensure_configured(wifi_spi_ports &p);
+
+void wifi_spi_deinit(wifi_spi_ports &p);
+
+// Reconfigures the clock block only if the clock divide has changed
+void wifi_spi_set_clock_divide(wifi_spi_ports &p, unsigned clock_divide);
+
+// Updates the CS timing without reconfiguring the ports
+void wifi_spi_set_cs_timing(wifi_spi_ports &p,
+                            unsigned cs_to_data_delay_ns,
+                            unsigned cs_hold_ns,
+                            unsigned cs_idle_ns);
+
 void wifi_spi_transfer(unsigned num_bytes, char *buffer, wifi_spi_ports &p,
                        wifi_spi_direction_t direction);
 
+// Transfers all of the segments in order under a single CS assertion
+unsafe void wifi_spi_transfer_segments(wifi_spi_segment_t * unsafe segments,
+                                       unsigned num_segments,
+                                       wifi_spi_ports &p);
+
+// Transfers all of the segments queued on a batch under a single CS assertion
+void wifi_spi_batch_transfer(wifi_spi_batch_t &batch, wifi_spi_ports &p);
+
+/** SPI engine task. Performs the transfers submitted over c with
+ *  wifi_spi_engine_submit() in order, so that the submitting core can carry on
+ *  while the data is on the wire. Returns when wifi_spi_engine_stop() is called.
+ */
+void wifi_spi_engine(streaming chanend c, wifi_spi_ports &p);
+
+// Queues the segments for transfer by the engine, which owns the segments and
+// the data they point to until wifi_spi_engine_complete() hands them back.
+// Nothing is copied.
+unsafe void wifi_spi_engine_submit(streaming chanend c,
+                                   wifi_spi_segment_t * unsafe segments,
+                                   unsigned num_segments);
+
+// Waits for the oldest submitted transfer to complete, returning the segments
+// it was submitted with
+unsafe wifi_spi_segment_t * unsafe wifi_spi_engine_complete(streaming chanend c);
+
+// Stops the engine task once all submitted transfers have completed
+void wifi_spi_engine_stop(streaming chanend c);
+
 void wifi_spi_drive_cs_port_now(wifi_spi_ports &p,
                                 uint32_t p_ss_bit,
                                 uint32_t bit_value);
@@ -49,4 +136,6 @@ void wifi_spi_drive_cs_port_get_time(wifi_spi_ports &p,
                                      uint32_t bit_value,
                                      unsigned *time);
 
+#endif // __XC__
+
 #endif // __wifi_spi_h__
@@ -0,0 +1,109 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#ifndef __wifi_trace_h__
+#define __wifi_trace_h__
+
+#include <stdint.h>
+
+/*
+ * Low overhead tracing of the WiFi driver. Each trace point records a
+ * timestamped event ID and one argument into a RAM ring, which is only
+ * formatted when wifi_trace_dump() is called. Trace points above the level set
+ * for their subsystem are compiled out completely.
+ */
+
+/** Trace levels */
+#define WIFI_TRACE_OFF     0 ///< Nothing recorded
+#define WIFI_TRACE_EVENTS  1 ///< Infrequent events: requests, stalls and drops
+#define WIFI_TRACE_PACKETS 2 ///< Every packet and bus transaction as well
+
+/** Trace level of each subsystem */
+#ifndef WIFI_TRACE_SPI
+#define WIFI_TRACE_SPI WIFI_TRACE_OFF
+#endif
+
+#ifndef WIFI_TRACE_SDPCM
+#define WIFI_TRACE_SDPCM WIFI_TRACE_OFF
+#endif
+
+#ifndef WIFI_TRACE_BUFFERS
+#define WIFI_TRACE_BUFFERS WIFI_TRACE_OFF
+#endif
+
+#ifndef WIFI_TRACE_CONTROL
+#define WIFI_TRACE_CONTROL WIFI_TRACE_OFF
+#endif
+
+#ifndef WIFI_TRACE_DATA
+#define WIFI_TRACE_DATA WIFI_TRACE_OFF
+#endif
+
+#ifndef WIFI_TRACE_RING_SIZE
+/** Number of events kept for each logical core, must be a power of two */
+#define WIFI_TRACE_RING_SIZE 32
+#endif
+
+#ifndef WIFI_TRACE_XSCOPE
+/** Set to 1 to also stream each event over xSCOPE as it is recorded. The
+ *  application's config.xscope must then have a probe named "WiFi trace",
+ *  or WIFI_TRACE_XSCOPE_PROBE must be set to another probe.
+ */
+#define WIFI_TRACE_XSCOPE 0
+#endif
+
+#ifndef WIFI_TRACE_XSCOPE_PROBE
+#define WIFI_TRACE_XSCOPE_PROBE WIFI_TRACE
+#endif
+
+/** Trace event IDs, grouped by subsystem */
+typedef enum {
+  // SPI
+  WIFI_TRACE_SPI_TRANSFER,       ///< arg: number of bytes
+  WIFI_TRACE_SPI_ENGINE_SUBMIT,  ///< arg: number of segments
+  // SDPCM
+  WIFI_TRACE_SDPCM_IRQ,          ///< arg: 0
+  WIFI_TRACE_SDPCM_TX,           ///< arg: buffer
+  WIFI_TRACE_SDPCM_RX,           ///< arg: buffer, 0 for a credit update
+  WIFI_TRACE_SDPCM_CREDIT_STALL, ///< arg: 0
+  WIFI_TRACE_SDPCM_BUS_SLEEP,    ///< arg: 0
+  // Buffers
+  WIFI_TRACE_BUFFERS_ALLOC_FAIL, ///< arg: requested size
+  WIFI_TRACE_BUFFERS_RX_DROP,    ///< arg: number in RX ring
+  WIFI_TRACE_BUFFERS_RX_PAUSE,   ///< arg: 1 when stopped, 0 when restarted
+  WIFI_TRACE_BUFFERS_TX_FULL,    ///< arg: dropped pbuf
+  WIFI_TRACE_BUFFERS_RX_STARVED, ///< arg: 1 when out of RX buffers, 0 after
+  WIFI_TRACE_BUFFERS_DATA_DROP,  ///< arg: packet dropped from control buffer
+  // Control
+  WIFI_TRACE_CONTROL_INIT_RADIO, ///< arg: result
+  WIFI_TRACE_CONTROL_SCAN,       ///< arg: number of networks found
+  WIFI_TRACE_CONTROL_JOIN,       ///< arg: index of network, -1 if by name
+  // Data
+  WIFI_TRACE_DATA_RX,            ///< arg: pbuf received from the WWD driver
+  WIFI_TRACE_DATA_RX_TAKEN,      ///< arg: first pbuf taken by the client
+  WIFI_TRACE_DATA_TX,            ///< arg: pbuf sent by the client
+  WIFI_TRACE_NUM_EVENTS
+} wifi_trace_event_t;
+
+/** A recorded event */
+typedef struct {
+  uint32_t timestamp; ///< Reference timer ticks
+  uint32_t event;     ///< wifi_trace_event_t
+  uint32_t arg;
+} wifi_trace_entry_t;
+
+/** Record an event. Use the WIFI_TRACE() macro rather than calling this
+ *  directly so that disabled trace points cost nothing.
+ */
+void wifi_trace_record(wifi_trace_event_t event, uint32_t arg);
+
+/** Print the events in the rings of all logical cores, oldest first */
+void wifi_trace_dump();
+
+/** Record event for the subsystem if its trace level is at least level */
+#define WIFI_TRACE(subsystem, level, event, arg) \
+  do { \
+    if (WIFI_TRACE_##subsystem >= (level)) { \
+      wifi_trace_record((event), (uint32_t)(arg)); \
+    } \
+  } while (0)
+
+#endif // __wifi_trace_h__
@@ -0,0 +1,90 @@
+#!/usr/bin/env python
+"""Compress a WLAN firmware image for lib_wifi.
+
+The compressed file can replace the original in the firmware filesystem under
+the same name, as the driver recognises it by its header. See
+src/broadcom_wiced/platform/wwd_firmware_lz.h for the format.
+
+Usage: compress_wifi_firmware.py <input> <output>
+"""
+import struct
+import sys
+
+MAGIC = b'WFZ1'
+WINDOW_BITS = 12
+WINDOW_SIZE = 1 << WINDOW_BITS
+MIN_MATCH = 3
+MAX_MATCH = MIN_MATCH + 15
+MAX_CHAIN = 64  # Candidate matches tried at each position
+
+
+def compress(data):
+    data = bytearray(data)
+    out = bytearray(MAGIC)
+    out += struct.pack('<IB3x', len(data), WINDOW_BITS)
+
+    # Positions of each three byte prefix, most recent last
+    chains = {}
+
+    def insert(pos):
+        if pos + MIN_MATCH <= len(data):
+            key = bytes(data[pos:pos + MIN_MATCH])
+            chains.setdefault(key, []).append(pos)
+
+    pos = 0
+    while pos < len(data):
+        flags_index = len(out)
+        out.append(0)
+        for bit in range(8):
+            if pos >= len(data):
+                break
+
+            best_length = 0
+            best_distance = 0
+            key = bytes(data[pos:pos + MIN_MATCH])
+            for candidate in reversed(chains.get(key, [])[-MAX_CHAIN:]):
+                distance = pos - candidate
+                if distance > WINDOW_SIZE:
+                    break
+                length = MIN_MATCH
+                limit = min(MAX_MATCH, len(data) - pos)
+                while (length < limit and
+                       data[candidate + length] == data[pos + length]):
+                    length += 1
+                if length > best_length:
+                    best_length = length
+                    best_distance = distance
+                    if length == limit:
+                        break
+
+            if best_length >= MIN_MATCH:
+                token = best_distance - 1
+                out.append(token & 0xFF)
+                out.append(((token >> 8) << 4) | (best_length - MIN_MATCH))
+                for i in range(best_length):
+                    insert(pos + i)
+                pos += best_length
+            else:
+                out[flags_index] |= 1 << bit
+                out.append(data[pos])
+                insert(pos)
+                pos += 1
+    return out
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write(__doc__)
+        return 1
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    compressed = compress(data)
+    with open(sys.argv[2], 'wb') as f:
+        f.write(compressed)
+    print('%s: %d bytes compressed to %d bytes' %
+          (sys.argv[1], len(data), len(compressed)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,36 @@
+#!/usr/bin/env python
+"""Write a WLAN firmware image as a C source file defining wifi_firmware_image
+and wifi_firmware_image_size, for applications that build lib_wifi with
+WWD_DIRECT_RESOURCES = 1.
+
+Usage: create_wifi_firmware_source.py <firmware image> <output .c file>
+"""
+import sys
+
+BYTES_PER_LINE = 12
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write(__doc__)
+        return 1
+    with open(sys.argv[1], 'rb') as f:
+        data = bytearray(f.read())
+
+    with open(sys.argv[2], 'w') as f:
+        f.write('// Generated by create_wifi_firmware_source.py from %s\n' %
+                sys.argv[1].replace('\\', '/').split('/')[-1])
+        f.write('#include <stdint.h>\n\n')
+        f.write('// Word aligned for WICED_HOST_REQUIRES_ALIGNED_MEMORY_ACCESS\n')
+        f.write('const uint8_t wifi_firmware_image[] '
+                '__attribute__((aligned(4))) = {\n')
+        for i in range(0, len(data), BYTES_PER_LINE):
+            line = data[i:i + BYTES_PER_LINE]
+            f.write('  ' + ', '.join('0x%02x' % b for b in line) + ',\n')
+        f.write('};\n\n')
+        f.write('const uint32_t wifi_firmware_image_size = %d;\n' % len(data))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -3,28 +3,204 @@
 #include "wwd_network_constants.h"
 #include "wwd_assert.h"
 #include <stddef.h>
-#include <timer.h>
-#include "lwip/memp.h"
+#include <xs1.h>
 #include "lwip/pbuf.h"
+#include "wifi_broadcom_wiced.h"
+#include "wifi_trace.h"
 
-// XXX: can be removed now we're using LWIP buffers
-// static wiced_buffer_t internal_buffer = 0;
-// static uint16_t internal_buffer_max_size = 0;
-// static uint16_t internal_buffer_curr_size = 0;
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+#error "LWIP_SUPPORT_CUSTOM_PBUF must be set, xtcp_conf.h should include wifi_conf_derived.h"
+#endif
+
+#if (WIFI_BUFFERS_RX_SMALL < 1) || (WIFI_BUFFERS_RX_LARGE < 1) || \
+    (WIFI_BUFFERS_TX_SMALL < 1) || (WIFI_BUFFERS_TX_LARGE < 1) || \
+    (WIFI_BUFFERS_CONTROL_SMALL < 1) || (WIFI_BUFFERS_CONTROL_LARGE < 1)
+#error "There must be at least one WWD buffer of each class in each partition"
+#endif
+
+/* Every packet in the RX ring holds a large RX buffer, so with no more than
+ * that any packet the client keeps hold of would stop the bus being read.
+ */
+#if WIFI_BUFFERS_RX_LARGE <= WIFI_RX_RING_DEPTH
+#error "WIFI_BUFFERS_RX_LARGE must be larger than WIFI_RX_RING_DEPTH"
+#endif
+
+/*
+ * WWD buffers are lwIP custom pbufs taken from fixed partitions rather than
+ * from the lwIP pool, so that a flood of received packets held by the client
+ * cannot use up the buffers needed to make control requests and read their
+ * responses. Freeing a buffer, which may happen on any logical core once lwIP
+ * has finished with it, returns it to its partition and wakes anything
+ * waiting for one.
+ */
+typedef enum {
+  WWD_BUFFER_RX,
+  WWD_BUFFER_TX,
+  WWD_BUFFER_CONTROL,
+  WWD_BUFFER_NUM_PARTITIONS
+} wwd_buffer_partition_t;
+
+typedef enum {
+  WWD_BUFFER_SMALL,
+  WWD_BUFFER_LARGE,
+  WWD_BUFFER_NUM_CLASSES
+} wwd_buffer_class_t;
+
+typedef struct wwd_buffer_block_t {
+  struct pbuf_custom custom; // Must be first, lwIP frees the pbuf it contains
+  struct wwd_buffer_block_t *next_free;
+  uint8_t partition;
+  uint8_t size_class;
+} wwd_buffer_block_t;
+
+// The payload follows the pbuf so that WWD can move headers within it
+typedef struct {
+  wwd_buffer_block_t block;
+  uint32_t payload[(WIFI_BUFFER_SMALL_SIZE + 3) / 4];
+} wwd_buffer_small_t;
+
+typedef struct {
+  wwd_buffer_block_t block;
+  uint32_t payload[(WICED_LINK_MTU + 3) / 4];
+} wwd_buffer_large_t;
+
+static wwd_buffer_small_t rx_small[WIFI_BUFFERS_RX_SMALL];
+static wwd_buffer_large_t rx_large[WIFI_BUFFERS_RX_LARGE];
+static wwd_buffer_small_t tx_small[WIFI_BUFFERS_TX_SMALL];
+static wwd_buffer_large_t tx_large[WIFI_BUFFERS_TX_LARGE];
+static wwd_buffer_small_t control_small[WIFI_BUFFERS_CONTROL_SMALL];
+static wwd_buffer_large_t control_large[WIFI_BUFFERS_CONTROL_LARGE];
+
+#define WWD_BUFFERS_TOTAL (WIFI_BUFFERS_RX_SMALL + WIFI_BUFFERS_RX_LARGE + \
+                           WIFI_BUFFERS_TX_SMALL + WIFI_BUFFERS_TX_LARGE + \
+                           WIFI_BUFFERS_CONTROL_SMALL + WIFI_BUFFERS_CONTROL_LARGE)
+
+static wwd_buffer_block_t *free_blocks[WWD_BUFFER_NUM_PARTITIONS][WWD_BUFFER_NUM_CLASSES];
+static unsigned num_free = 0;
+static int buffers_initialised = 0;
+
+// Set while reading the bus has stopped for want of an RX or control buffer
+static volatile int rx_starved = 0;
+
+/* A logical core waiting for a buffer blocks on a channel end connected to
+ * itself, which is sent a control token when a buffer is freed. Only the
+ * logical core making control requests ever waits.
+ */
+static unsigned buffers_event_chanend;
+static int buffers_waiting = 0;
+
+static void buffers_free(struct pbuf *p);
+
+static void buffers_add(wwd_buffer_partition_t partition,
+                        wwd_buffer_class_t size_class, uint8_t *blocks,
+                        unsigned count, unsigned stride) {
+  for (unsigned i = 0; i < count; i++) {
+    wwd_buffer_block_t *block = (wwd_buffer_block_t *)&blocks[i * stride];
+    block->custom.custom_free_function = buffers_free;
+    block->partition = partition;
+    block->size_class = size_class;
+    block->next_free = free_blocks[partition][size_class];
+    free_blocks[partition][size_class] = block;
+    num_free++;
+  }
+}
+
+/* The first buffer is taken by wwd_management_init() before the WWD thread is
+ * started, so there is no race to set up the partitions.
+ */
+static void buffers_init() {
+  asm volatile ("getr %0, %1"
+                : "=r" (buffers_event_chanend)
+                : "n" (XS1_RES_TYPE_CHANEND));
+  wiced_assert("No buffer event chanend available", buffers_event_chanend != 0);
+  asm volatile ("setd res[%0], %0"
+                : /* no output */
+                : "r" (buffers_event_chanend));
+
+  buffers_add(WWD_BUFFER_RX, WWD_BUFFER_SMALL, (uint8_t *)rx_small,
+              WIFI_BUFFERS_RX_SMALL, sizeof(wwd_buffer_small_t));
+  buffers_add(WWD_BUFFER_RX, WWD_BUFFER_LARGE, (uint8_t *)rx_large,
+              WIFI_BUFFERS_RX_LARGE, sizeof(wwd_buffer_large_t));
+  buffers_add(WWD_BUFFER_TX, WWD_BUFFER_SMALL, (uint8_t *)tx_small,
+              WIFI_BUFFERS_TX_SMALL, sizeof(wwd_buffer_small_t));
+  buffers_add(WWD_BUFFER_TX, WWD_BUFFER_LARGE, (uint8_t *)tx_large,
+              WIFI_BUFFERS_TX_LARGE, sizeof(wwd_buffer_large_t));
+  buffers_add(WWD_BUFFER_CONTROL, WWD_BUFFER_SMALL, (uint8_t *)control_small,
+              WIFI_BUFFERS_CONTROL_SMALL, sizeof(wwd_buffer_small_t));
+  buffers_add(WWD_BUFFER_CONTROL, WWD_BUFFER_LARGE, (uint8_t *)control_large,
+              WIFI_BUFFERS_CONTROL_LARGE, sizeof(wwd_buffer_large_t));
+  buffers_initialised = 1;
+}
+
+// Take the smallest free block that will hold size bytes. Call with the lock
+static wwd_buffer_block_t *buffers_take(wwd_buffer_partition_t partition,
+                                        unsigned size) {
+  wwd_buffer_class_t size_class = (size <= WIFI_BUFFER_SMALL_SIZE) ?
+                                  WWD_BUFFER_SMALL : WWD_BUFFER_LARGE;
+  for (; size_class < WWD_BUFFER_NUM_CLASSES; size_class++) {
+    wwd_buffer_block_t *block = free_blocks[partition][size_class];
+    if (block != NULL) {
+      free_blocks[partition][size_class] = block->next_free;
+      num_free--;
+      return block;
+    }
+  }
+  return NULL;
+}
+
+// Called by lwIP when the last reference to a WWD buffer is freed
+static void buffers_free(struct pbuf *p) {
+  wwd_buffer_block_t *block = (wwd_buffer_block_t *)p;
+
+  hwlock_acquire(xcore_wiced_lock);
+  block->next_free = free_blocks[block->partition][block->size_class];
+  free_blocks[block->partition][block->size_class] = block;
+  num_free++;
+
+  int wake_waiter = buffers_waiting;
+  buffers_waiting = 0;
+  int resume_rx = rx_starved && (block->partition != WWD_BUFFER_TX);
+  if (resume_rx) {
+    rx_starved = 0;
+  }
+  hwlock_release(xcore_wiced_lock);
+
+  if (wake_waiter) {
+    asm volatile ("outct res[%0], %1"
+                  : /* no output */
+                  : "r" (buffers_event_chanend), "r" (XS1_CT_END));
+  }
+  if (resume_rx) {
+    WIFI_TRACE(BUFFERS, WIFI_TRACE_EVENTS, WIFI_TRACE_BUFFERS_RX_STARVED, 0);
+    xcore_wwd_send_control_signal(XCORE_WWD_RX_RESUME);
+  }
+}
+
+int xcore_wiced_buffer_is_control(wiced_buffer_t p) {
+  return (p->flags & PBUF_FLAG_IS_CUSTOM) &&
+         (((wwd_buffer_block_t *)p)->partition == WWD_BUFFER_CONTROL);
+}
+
+int xcore_wiced_buffers_rx_starved() {
+  return rx_starved;
+}
 
 wwd_result_t host_buffer_init(void *native_arg) {
-  // No action required
+  // The partitions are set up when the first buffer is taken
   return WWD_SUCCESS;
 }
 
 wwd_result_t host_buffer_check_leaked() {
-  wiced_assert("pbuf pool Buffer leakage", memp_in_use(MEMP_PBUF_POOL) == 0);
-  wiced_assert("pbuf ref/rom Buffer leakage", memp_in_use(MEMP_PBUF) == 0);
+  wiced_assert("WWD buffer leakage",
+               !buffers_initialised || (num_free == WWD_BUFFERS_TOTAL));
   return WWD_SUCCESS;
 }
 
 wwd_result_t host_buffer_get(wiced_buffer_t *buffer, wwd_buffer_dir_t direction,
                              unsigned short size, wiced_bool_t wait) {
+  wwd_buffer_block_t *block;
+  int starved = 0;
+
   wiced_assert("Error: Invalid buffer size\n", size != 0);
 
   *buffer = NULL;
@@ -34,20 +210,70 @@ wwd_result_t host_buffer_get(wiced_buffer_t *buffer, wwd_buffer_dir_t direction,
     return WWD_BUFFER_UNAVAILABLE_PERMANENT;
   }
 
-  do {
-    *buffer = pbuf_alloc(PBUF_RAW, size, PBUF_POOL);
-  } while ((*buffer == NULL) &&
-           (wait == WICED_TRUE) &&
-           (delay_ticks(1), 1 == 1));
-  if (*buffer == NULL) {
-    debug_printf("Failed to allocate packet buffer\n");
+  if (!buffers_initialised) {
+    buffers_init();
+  }
+
+  hwlock_acquire(xcore_wiced_lock);
+  while (1) {
+    if (direction == WWD_NETWORK_TX) {
+      block = buffers_take(WWD_BUFFER_TX, size);
+    } else {
+      // Fall back to the control partition, whatever the frame turns out to be
+      block = buffers_take(WWD_BUFFER_RX, size);
+      if (block == NULL) {
+        block = buffers_take(WWD_BUFFER_CONTROL, size);
+      }
+      if ((block == NULL) && !rx_starved) {
+        rx_starved = 1;
+        starved = 1;
+      }
+    }
+    if ((block != NULL) || (wait != WICED_TRUE)) {
+      break;
+    }
+
+    // Wait for a buffer to be freed rather than polling for one
+    wiced_assert("Only one logical core can wait for a buffer", !buffers_waiting);
+    buffers_waiting = 1;
+    hwlock_release(xcore_wiced_lock);
+    xcore_wwd_semaphore_wait(buffers_event_chanend, 0, 1);
+    hwlock_acquire(xcore_wiced_lock);
+  }
+  hwlock_release(xcore_wiced_lock);
+
+  if (starved) {
+    WIFI_TRACE(BUFFERS, WIFI_TRACE_EVENTS, WIFI_TRACE_BUFFERS_RX_STARVED, 1);
+  }
+  if (block == NULL) {
+    WIFI_TRACE(BUFFERS, WIFI_TRACE_EVENTS, WIFI_TRACE_BUFFERS_ALLOC_FAIL, size);
+    xcore_wiced_stats_pbuf_alloc_failure();
     return WWD_BUFFER_UNAVAILABLE_TEMPORARY;
   }
+
+  if (block->size_class == WWD_BUFFER_SMALL) {
+    *buffer = pbuf_alloced_custom(PBUF_RAW, size, PBUF_POOL, &block->custom,
+                                  ((wwd_buffer_small_t *)block)->payload,
+                                  WIFI_BUFFER_SMALL_SIZE);
+  } else {
+    *buffer = pbuf_alloced_custom(PBUF_RAW, size, PBUF_POOL, &block->custom,
+                                  ((wwd_buffer_large_t *)block)->payload,
+                                  WICED_LINK_MTU);
+  }
   return WWD_SUCCESS;
 }
 
 void host_buffer_release(wiced_buffer_t buffer, wwd_buffer_dir_t direction) {
   wiced_assert("Error: Invalid buffer\n", buffer != NULL);
+  if (direction == WWD_NETWORK_TX) {
+#if WIFI_SPI_ENGINE
+    if (xcore_wiced_spi_release_later(buffer)) {
+      // Still queued, so that it is not sent again while on the wire
+      return;
+    }
+#endif
+    xcore_wiced_tx_queue_release(buffer);
+  }
   pbuf_free(buffer); /* Ignore returned number of freed segments since TCP
                       * packets will still be referenced by LWIP after release
                       * by WICED
@@ -59,8 +285,16 @@ uint8_t* host_buffer_get_current_piece_data_pointer(wiced_buffer_t buffer) {
   return (uint8_t*) buffer->payload;
 }
 
+/* A chained data packet being sent is reported as a single piece covering the
+ * whole chain so that the SDPCM and gSPI headers describe the full frame. The
+ * SPI layer then gathers the remaining pieces straight from the chain
+ * (see host_platform_spi_transfer()). Every other buffer is one piece.
+ */
 uint16_t host_buffer_get_current_piece_size(wiced_buffer_t buffer) {
   wiced_assert("Error: Invalid buffer\n", buffer != NULL);
+  if (buffer->flags & XCORE_WICED_PBUF_FLAG_TX_GATHER) {
+    return (uint16_t) buffer->tot_len;
+  }
   return (uint16_t) buffer->len;
 }
 
@@ -79,12 +313,32 @@ wwd_result_t host_buffer_add_remove_at_front(wiced_buffer_t * buffer,
   return WWD_SUCCESS;
 }
 
+// The end of the payload space of a WWD buffer, or NULL for an lwIP pbuf
+static uint8_t *buffers_payload_end(wiced_buffer_t buffer) {
+  if (!(buffer->flags & PBUF_FLAG_IS_CUSTOM)) {
+    return NULL;
+  }
+  wwd_buffer_block_t *block = (wwd_buffer_block_t *)buffer;
+  if (block->size_class == WWD_BUFFER_SMALL) {
+    return (uint8_t *)((wwd_buffer_small_t *)block)->payload +
+           WIFI_BUFFER_SMALL_SIZE;
+  }
+  return (uint8_t *)((wwd_buffer_large_t *)block)->payload + WICED_LINK_MTU;
+}
+
 wwd_result_t host_buffer_set_size(wiced_buffer_t buffer, unsigned short size) {
   if (size > (unsigned short)WICED_LINK_MTU) {
     WPRINT_NETWORK_ERROR(("Attempt to set a length larger than the MTU of the link\n"));
     return WWD_BUFFER_SIZE_SET_ERROR;
   }
 
+  // A small buffer only has room for WIFI_BUFFER_SMALL_SIZE bytes
+  uint8_t *end = buffers_payload_end(buffer);
+  if ((end != NULL) && ((uint8_t *)buffer->payload + size > end)) {
+    WPRINT_NETWORK_ERROR(("Attempt to set a length larger than the buffer\n"));
+    return WWD_BUFFER_SIZE_SET_ERROR;
+  }
+
   buffer->tot_len = size;
   buffer->len = size;
 
@@ -1,8 +1,121 @@
 // Copyright (c) 2015-2017, XMOS Ltd, All rights reserved
 #include "wwd_network_interface.h"
+#include "wwd_buffer_interface.h"
 #include "wifi_broadcom_wiced.h"
+#include "wifi.h"
+#include "wifi_trace.h"
+#include "xcore_netif_queue.h"
+#include "lwip/pbuf.h"
+
+// Set while the RX ring is full and the WWD thread should not read the bus
+static volatile int rx_paused = 0;
+
+// Set while the interface task is waiting for the response to a control request
+static volatile int control_active = 0;
+
+/* Data packets passed to the WWD driver and not yet released by it, with the
+ * time each was queued at. Packets are queued by the interface task, or by
+ * lwIP with WIFI_DIRECT_NETIF, and released by the WWD thread, so the queue
+ * and the pbuf flags marking its packets are only changed under
+ * xcore_wiced_lock. A packet is looked up by its pbuf when it is released, as
+ * WWD need not send packets in the order they were queued.
+ */
+static wiced_buffer_t tx_queue[WIFI_TX_QUEUE_DEPTH];
+static unsigned tx_queue_times[WIFI_TX_QUEUE_DEPTH];
+static volatile unsigned tx_queue_count = 0;
+
+extern unsigned xcore_get_ticks();
 
 void host_network_process_ethernet_data(wiced_buffer_t p,
                                         wwd_interface_t interface) {
+  if (xcore_wiced_buffer_is_control(p)) {
+    // All of the RX buffers are in use, so keep this one for control traffic
+    WIFI_TRACE(BUFFERS, WIFI_TRACE_EVENTS, WIFI_TRACE_BUFFERS_DATA_DROP, p);
+    xcore_wiced_stats_pbuf_alloc_failure();
+    host_buffer_release(p, WWD_NETWORK_RX);
+    return;
+  }
+#if WIFI_DIRECT_NETIF
+  xcore_netif_queue_put(p);
+#else
   xcore_wiced_send_pbuf_to_internal(p);
+#endif
+}
+
+void xcore_wiced_set_rx_paused(int paused) {
+  rx_paused = paused;
+}
+
+int xcore_wiced_rx_paused() {
+  return rx_paused || xcore_wiced_buffers_rx_starved();
+}
+
+void xcore_wiced_set_control_active(int active) {
+  control_active = active;
+}
+
+int xcore_wiced_control_active() {
+  return control_active;
+}
+
+xcore_wiced_tx_reserve_t xcore_wiced_tx_queue_reserve(wiced_buffer_t p) {
+  xcore_wiced_tx_reserve_t result = XCORE_WICED_TX_QUEUE_FULL;
+  unsigned now = xcore_get_ticks();
+
+  hwlock_acquire(xcore_wiced_lock);
+  if (p->flags & XCORE_WICED_PBUF_FLAG_TX_QUEUED) {
+    // Not yet sent, e.g. a TCP retransmission of a segment still queued
+    result = XCORE_WICED_TX_ALREADY_QUEUED;
+  } else if (tx_queue_count < WIFI_TX_QUEUE_DEPTH) {
+    for (unsigned i = 0; i < WIFI_TX_QUEUE_DEPTH; i++) {
+      if (tx_queue[i] == NULL) {
+        tx_queue[i] = p;
+        tx_queue_times[i] = now;
+        break;
+      }
+    }
+    tx_queue_count++;
+    p->flags |= XCORE_WICED_PBUF_FLAG_TX_QUEUED;
+    if (p->next != NULL) {
+      // Sent without being linearised, see host_buffer_get_current_piece_size()
+      p->flags |= XCORE_WICED_PBUF_FLAG_TX_GATHER;
+    }
+    result = XCORE_WICED_TX_RESERVED;
+  }
+  hwlock_release(xcore_wiced_lock);
+  return result;
+}
+
+void xcore_wiced_tx_queue_release(wiced_buffer_t p) {
+  unsigned queued_time = 0;
+  int released = 0;
+
+  hwlock_acquire(xcore_wiced_lock);
+  if (p->flags & XCORE_WICED_PBUF_FLAG_TX_QUEUED) {
+    p->flags &= ~(XCORE_WICED_PBUF_FLAG_TX_QUEUED |
+                  XCORE_WICED_PBUF_FLAG_TX_GATHER);
+    for (unsigned i = 0; i < WIFI_TX_QUEUE_DEPTH; i++) {
+      if (tx_queue[i] == p) {
+        tx_queue[i] = NULL;
+        queued_time = tx_queue_times[i];
+        break;
+      }
+    }
+    tx_queue_count--;
+    released = 1;
+  }
+  hwlock_release(xcore_wiced_lock);
+
+  if (released) {
+    xcore_wiced_stats_add_latency(xcore_wiced_stats.send_to_wire,
+                                  xcore_get_ticks() - queued_time);
+  }
+}
+
+int wifi_tx_queue_full() {
+  return tx_queue_count >= WIFI_TX_QUEUE_DEPTH;
+}
+
+unsigned xcore_wiced_tx_queue_count() {
+  return tx_queue_count;
 }
@@ -0,0 +1,173 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include "xcore_netif_queue.h"
+#include "wwd_network_interface.h"
+#include "wifi_broadcom_wiced.h"
+#include "wifi.h"
+#include "wifi_trace.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+#include <xs1.h>
+
+#if WIFI_DIRECT_NETIF
+
+extern unsigned xcore_get_ticks();
+
+/* The queue is shared by the WWD thread and xtcp_lwip_wifi(), which run on
+ * different logical cores. The WWD thread only writes tail, notified and the
+ * counters, and xtcp_lwip_wifi() only writes head and clears notified. One
+ * slot is always left empty so that a full queue has head != tail.
+ */
+#define QUEUE_SLOTS (WIFI_RX_RING_DEPTH + 1)
+static struct pbuf *volatile buffers[QUEUE_SLOTS];
+static volatile unsigned rx_times[QUEUE_SLOTS]; // Timer value each read started at
+static volatile unsigned head;
+static volatile unsigned tail;
+static volatile unsigned notified;
+static unsigned notification_chanend;
+
+static unsigned high_water_mark;
+static unsigned dropped;
+static unsigned paused;
+
+static unsigned queue_count() {
+  unsigned count = tail + QUEUE_SLOTS - head;
+  return (count >= QUEUE_SLOTS) ? count - QUEUE_SLOTS : count;
+}
+
+static unsigned queue_next(unsigned index) {
+  index += 1;
+  return (index == QUEUE_SLOTS) ? 0 : index;
+}
+
+#if WIFI_RX_OVERFLOW_POLICY == WIFI_RX_STOP_READING
+static void queue_pause() {
+  WIFI_TRACE(BUFFERS, WIFI_TRACE_EVENTS, WIFI_TRACE_BUFFERS_RX_PAUSE, 1);
+  xcore_wiced_set_rx_paused(1);
+  paused++;
+}
+#endif
+
+void xcore_netif_queue_init(unsigned chanend) {
+  head = 0;
+  tail = 0;
+  notified = 0;
+  high_water_mark = 0;
+  dropped = 0;
+  paused = 0;
+  notification_chanend = chanend;
+}
+
+void xcore_netif_queue_put(struct pbuf *p) {
+  WIFI_TRACE(DATA, WIFI_TRACE_PACKETS, WIFI_TRACE_DATA_RX, p);
+  xcore_wiced_stats_netif_rx(p->tot_len);
+
+  unsigned count = queue_count();
+  if (count == WIFI_RX_RING_DEPTH) {
+    dropped++;
+    WIFI_TRACE(BUFFERS, WIFI_TRACE_EVENTS, WIFI_TRACE_BUFFERS_RX_DROP, count);
+    // Packets already read from the bus when reading was stopped end up here,
+    // as do those read for a control request
+    pbuf_free(p);
+#if WIFI_RX_OVERFLOW_POLICY == WIFI_RX_STOP_READING
+    if (!xcore_wiced_control_active() && !xcore_wiced_rx_paused()) {
+      // The queue filled during a control request, so stop reading now
+      queue_pause();
+    }
+#endif
+    return;
+  }
+
+  buffers[tail] = p;
+  rx_times[tail] = xcore_wiced_rx_start_time();
+  tail = queue_next(tail);
+  count++;
+  if (count > high_water_mark) {
+    high_water_mark = count;
+  }
+
+#if WIFI_RX_OVERFLOW_POLICY == WIFI_RX_STOP_READING
+  // A control request waiting for its response has the bus read regardless
+  if (count == WIFI_RX_RING_DEPTH && !xcore_wiced_control_active()) {
+    queue_pause();
+  }
+#endif
+
+  XCORE_WWD_SIGNALS_BARRIER();
+  // A notification already waiting will be taken after this packet was put
+  if (!notified) {
+    notified = 1;
+    int notification = XS1_CT_END;
+    asm volatile ("outct res[%0], %1"
+                    : // No dests
+                    : "r" (notification_chanend),
+                      "r" (notification));
+  }
+}
+
+void xcore_netif_queue_notified() {
+  notified = 0;
+  XCORE_WWD_SIGNALS_BARRIER();
+}
+
+struct pbuf *xcore_netif_queue_take() {
+  if (head == tail) {
+    return NULL;
+  }
+  struct pbuf *p = buffers[head];
+  unsigned rx_time = rx_times[head];
+  head = queue_next(head);
+
+#if WIFI_RX_OVERFLOW_POLICY == WIFI_RX_STOP_READING
+  if (xcore_wiced_rx_paused()) {
+    // There is space again, so let the WWD thread read the bus
+    WIFI_TRACE(BUFFERS, WIFI_TRACE_EVENTS, WIFI_TRACE_BUFFERS_RX_PAUSE, 0);
+    xcore_wiced_set_rx_paused(0);
+    xcore_wwd_send_control_signal(XCORE_WWD_RX_RESUME);
+  }
+#endif
+
+  WIFI_TRACE(DATA, WIFI_TRACE_PACKETS, WIFI_TRACE_DATA_RX_TAKEN, p);
+  xcore_wiced_stats_add_latency(xcore_wiced_stats.irq_to_delivery,
+                                xcore_get_ticks() - rx_time);
+  return p;
+}
+
+void xcore_netif_queue_get_stats(wifi_rx_ring_stats_t *stats) {
+  stats->depth = WIFI_RX_RING_DEPTH;
+  stats->count = queue_count();
+  stats->high_water_mark = high_water_mark;
+  stats->dropped = dropped;
+  stats->paused = paused;
+}
+
+void xcore_netif_queue_reset_stats() {
+  dropped = 0;
+}
+
+/* Sends a packet as the interface task does for send_packet() */
+static err_t linkoutput(struct netif *netif, struct pbuf *p) {
+  WIFI_TRACE(DATA, WIFI_TRACE_PACKETS, WIFI_TRACE_DATA_TX, p);
+  xcore_wiced_tx_reserve_t reserved = xcore_wiced_tx_queue_reserve(p);
+  if (reserved == XCORE_WICED_TX_ALREADY_QUEUED) {
+    // It goes out once, when the WWD driver reaches it
+    return ERR_OK;
+  }
+  if (reserved == XCORE_WICED_TX_QUEUE_FULL) {
+    // Already WIFI_TX_QUEUE_DEPTH packets waiting for SDPCM credits
+    WIFI_TRACE(BUFFERS, WIFI_TRACE_EVENTS, WIFI_TRACE_BUFFERS_TX_FULL, p);
+    xcore_wiced_stats_netif_tx_drop();
+    // Tell lwIP it was not sent, so that TCP can retransmit it later
+    return ERR_MEM;
+  }
+  xcore_wiced_stats_netif_tx(p->tot_len);
+  // lwIP frees the packet on return, and the WWD driver once it is sent
+  pbuf_ref(p);
+  wwd_network_send_ethernet_data(p, WWD_STA_INTERFACE);
+  return ERR_OK;
+}
+
+void xcore_netif_queue_attach(struct netif *netif) {
+  netif->linkoutput = linkoutput;
+}
+
+#endif // WIFI_DIRECT_NETIF
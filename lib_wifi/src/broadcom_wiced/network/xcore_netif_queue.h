@@ -0,0 +1,57 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#ifndef __xcore_netif_queue_h__
+#define __xcore_netif_queue_h__
+
+#include "xc2compat.h"
+#include <xccompat.h>
+#include "wifi.h"
+
+/** Hand received packets straight from the WWD thread to xtcp_lwip_wifi(),
+ *  and send packets from lwIP straight to the WWD driver, rather than through
+ *  the driver's interface task and the xtcp_pbuf_if. lwIP must then run on
+ *  the same tile as the driver. The xtcp_pbuf_if is still connected but
+ *  carries no packets.
+ */
+#ifndef WIFI_DIRECT_NETIF
+#define WIFI_DIRECT_NETIF 0
+#endif
+
+struct pbuf;
+struct netif;
+
+/**
+ * The queue of received packets waiting for xtcp_lwip_wifi(), WIFI_RX_RING_DEPTH
+ * deep. Only the WWD thread puts packets and only xtcp_lwip_wifi() takes them,
+ * so it needs no lock. A control token is sent to the notification channel end
+ * when a packet is put and no notification is already waiting.
+ *
+ * With WIFI_RX_DROP_OLDEST packets that arrive while the queue is full are
+ * freed as for WIFI_RX_DROP_NEWEST, as only the taker may move the head.
+ */
+
+/** Start with the queue empty, notifying a channel end connected to itself */
+void xcore_netif_queue_init(unsigned notification_chanend);
+
+/** Queue a packet received by the WWD thread */
+void xcore_netif_queue_put(struct pbuf * unsafe p);
+
+/** Note that a notification has been received. Must be called before taking
+ *  the packets it was sent for, so that one put meanwhile sends another.
+ */
+void xcore_netif_queue_notified();
+
+/** Take the oldest packet, or NULL if there is none */
+struct pbuf * unsafe xcore_netif_queue_take();
+
+/** Get the queue's counters, as for get_rx_ring_stats() */
+void xcore_netif_queue_get_stats(REFERENCE_PARAM(wifi_rx_ring_stats_t, stats));
+
+/** Zero the count of dropped packets */
+void xcore_netif_queue_reset_stats();
+
+/** Make a netif send its packets straight to the WWD driver. Called once the
+ *  netif has been initialised.
+ */
+void xcore_netif_queue_attach(REFERENCE_PARAM(struct netif, netif));
+
+#endif // __xcore_netif_queue_h__
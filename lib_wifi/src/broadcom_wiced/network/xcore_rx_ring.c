@@ -0,0 +1,124 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include "xcore_rx_ring.h"
+#include "xcore_wwd_signals.h"
+#include "wifi_trace.h"
+#include <stddef.h>
+
+#if (WIFI_RX_OVERFLOW_POLICY != WIFI_RX_DROP_NEWEST) && \
+    (WIFI_RX_OVERFLOW_POLICY != WIFI_RX_DROP_OLDEST) && \
+    (WIFI_RX_OVERFLOW_POLICY != WIFI_RX_STOP_READING)
+#error "WIFI_RX_OVERFLOW_POLICY must be one of the WIFI_RX_* policies"
+#endif
+
+#if WIFI_RX_RING_DEPTH < 1
+#error "WIFI_RX_RING_DEPTH must be at least 1"
+#endif
+
+void xcore_rx_ring_init(xcore_rx_ring_t *ring) {
+  ring->head = 0;
+  ring->count = 0;
+  ring->high_water_mark = 0;
+  ring->dropped = 0;
+  ring->paused = 0;
+}
+
+#if WIFI_RX_OVERFLOW_POLICY == WIFI_RX_STOP_READING
+static void ring_pause(xcore_rx_ring_t *ring) {
+  WIFI_TRACE(BUFFERS, WIFI_TRACE_EVENTS, WIFI_TRACE_BUFFERS_RX_PAUSE, 1);
+  xcore_wiced_set_rx_paused(1);
+  ring->paused += 1;
+}
+
+static void ring_resume() {
+  WIFI_TRACE(BUFFERS, WIFI_TRACE_EVENTS, WIFI_TRACE_BUFFERS_RX_PAUSE, 0);
+  xcore_wiced_set_rx_paused(0);
+  xcore_wwd_send_control_signal(XCORE_WWD_RX_RESUME);
+}
+#endif
+
+struct pbuf *xcore_rx_ring_take(xcore_rx_ring_t *ring, unsigned *rx_time) {
+  unsigned read_index = ring->head;
+  ring->head += 1;
+  if (ring->head == WIFI_RX_RING_DEPTH) {
+    ring->head = 0;
+  }
+  ring->count -= 1;
+
+#if WIFI_RX_OVERFLOW_POLICY == WIFI_RX_STOP_READING
+  if (xcore_wiced_rx_paused()) {
+    // There is space again, so let the WWD thread read the bus
+    ring_resume();
+  }
+#endif
+  *rx_time = ring->rx_times[read_index];
+  return ring->buffers[read_index];
+}
+
+struct pbuf *xcore_rx_ring_put(xcore_rx_ring_t *ring, struct pbuf *p,
+                               unsigned rx_time) {
+  struct pbuf *dropped = NULL;
+
+  if (ring->count == WIFI_RX_RING_DEPTH) {
+    ring->dropped += 1;
+    WIFI_TRACE(BUFFERS, WIFI_TRACE_EVENTS, WIFI_TRACE_BUFFERS_RX_DROP,
+               ring->count);
+#if WIFI_RX_OVERFLOW_POLICY == WIFI_RX_DROP_OLDEST
+    unsigned dropped_time;
+    dropped = xcore_rx_ring_take(ring, &dropped_time);
+#else
+    // Packets already read from the bus when reading was stopped end up here,
+    // as do those read for a control request
+    return p;
+#endif
+  }
+
+  unsigned write_index = ring->head + ring->count;
+  if (write_index >= WIFI_RX_RING_DEPTH) {
+    write_index -= WIFI_RX_RING_DEPTH;
+  }
+  ring->buffers[write_index] = p;
+  ring->rx_times[write_index] = rx_time;
+  ring->count += 1;
+  if (ring->count > ring->high_water_mark) {
+    ring->high_water_mark = ring->count;
+  }
+
+#if WIFI_RX_OVERFLOW_POLICY == WIFI_RX_STOP_READING
+  // A control request waiting for its response has the bus read regardless
+  if (ring->count == WIFI_RX_RING_DEPTH && !xcore_wiced_control_active()) {
+    ring_pause(ring);
+  }
+#endif
+  return dropped;
+}
+
+int xcore_rx_ring_is_empty(xcore_rx_ring_t *ring) {
+  return (ring->count == 0);
+}
+
+void xcore_rx_ring_control_begin(xcore_rx_ring_t *ring) {
+  xcore_wiced_set_control_active(1);
+#if WIFI_RX_OVERFLOW_POLICY == WIFI_RX_STOP_READING
+  if (xcore_wiced_rx_paused()) {
+    ring_resume();
+  }
+#endif
+}
+
+void xcore_rx_ring_control_end(xcore_rx_ring_t *ring) {
+  xcore_wiced_set_control_active(0);
+#if WIFI_RX_OVERFLOW_POLICY == WIFI_RX_STOP_READING
+  if (ring->count == WIFI_RX_RING_DEPTH && !xcore_wiced_rx_paused()) {
+    ring_pause(ring);
+  }
+#endif
+}
+
+void xcore_rx_ring_get_stats(xcore_rx_ring_t *ring,
+                             wifi_rx_ring_stats_t *stats) {
+  stats->depth = WIFI_RX_RING_DEPTH;
+  stats->count = ring->count;
+  stats->high_water_mark = ring->high_water_mark;
+  stats->dropped = ring->dropped;
+  stats->paused = ring->paused;
+}
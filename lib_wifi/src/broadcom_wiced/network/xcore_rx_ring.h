@@ -0,0 +1,81 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#ifndef __xcore_rx_ring_h__
+#define __xcore_rx_ring_h__
+
+#include "xc2compat.h"
+#include <xccompat.h>
+#include "wifi.h"
+
+struct pbuf;
+
+/**
+ * A ring of received pbuf pointers waiting for the client of the xtcp_pbuf_if
+ * to take them, with counters for when it overflows. It is only used by the
+ * driver's interface task, which handles WIFI_RX_OVERFLOW_POLICY for it.
+ *
+ * With WIFI_RX_STOP_READING the WWD thread stops reading the bus when the
+ * ring fills and starts again when a packet is taken. Control responses share
+ * the bus with packets, so while a control request is in progress reading is
+ * not stopped and packets that do not fit are dropped instead.
+ */
+typedef struct {
+  struct pbuf * unsafe buffers[WIFI_RX_RING_DEPTH];
+  unsigned rx_times[WIFI_RX_RING_DEPTH]; ///< Timer value each read started at
+  unsigned head;
+  unsigned count;
+  unsigned high_water_mark;
+  unsigned dropped;
+  unsigned paused;
+} xcore_rx_ring_t;
+
+/** Start with the ring empty and the counters zeroed */
+void xcore_rx_ring_init(REFERENCE_PARAM(xcore_rx_ring_t, ring));
+
+/** Queue a received pbuf. Returns the pbuf that has to be freed because the
+ *  ring was full, or NULL if nothing was dropped.
+ */
+struct pbuf * unsafe xcore_rx_ring_put(REFERENCE_PARAM(xcore_rx_ring_t, ring),
+                                       struct pbuf * unsafe p,
+                                       unsigned rx_time);
+
+/** Take the oldest pbuf, and the time its read started at. The ring must not
+ *  be empty.
+ */
+struct pbuf * unsafe xcore_rx_ring_take(REFERENCE_PARAM(xcore_rx_ring_t, ring),
+                                        REFERENCE_PARAM(unsigned, rx_time));
+
+/** Whether there are no pbufs to take */
+int xcore_rx_ring_is_empty(REFERENCE_PARAM(xcore_rx_ring_t, ring));
+
+/** Make sure the bus is read until xcore_rx_ring_control_end() is called, so
+ *  that the response to a control request is not held up by a full ring
+ */
+void xcore_rx_ring_control_begin(REFERENCE_PARAM(xcore_rx_ring_t, ring));
+
+/** Stop reading the bus again if the ring filled during a control request */
+void xcore_rx_ring_control_end(REFERENCE_PARAM(xcore_rx_ring_t, ring));
+
+/** Get the ring's counters, as for get_rx_ring_stats() */
+void xcore_rx_ring_get_stats(REFERENCE_PARAM(xcore_rx_ring_t, ring),
+                             REFERENCE_PARAM(wifi_rx_ring_stats_t, stats));
+
+/** Stop or restart reading packets from the bus, used when the RX ring is
+ *  full with the WIFI_RX_STOP_READING overflow policy
+ */
+void xcore_wiced_set_rx_paused(int paused);
+
+/** Whether reading packets from the bus is stopped, either by a full RX ring
+ *  or because there are no RX or control buffers to read into
+ */
+int xcore_wiced_rx_paused();
+
+/** Mark the start and end of a control request. Its response arrives on the
+ *  bus along with packets, so reading is not stopped meanwhile: packets that
+ *  do not fit in the RX ring are dropped instead.
+ */
+void xcore_wiced_set_control_active(int active);
+
+/** Whether a control request is waiting for its response */
+int xcore_wiced_control_active();
+
+#endif // __xcore_rx_ring_h__
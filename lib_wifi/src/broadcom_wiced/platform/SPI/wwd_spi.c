@@ -3,6 +3,31 @@
 #include "platform/wwd_spi_interface.h"
 #include "platform_config.h"
 #include "wifi_broadcom_wiced.h"
+#include "wifi_trace.h"
+#include "wwd_assert.h"
+#include "lwip/pbuf.h"
+
+/* With status reporting enabled the WLAN chip follows every gSPI transaction
+ * with a 32-bit status word. Reading it under the same CS assertion as the
+ * command and payload lets the WWD thread see whether another frame is waiting
+ * without a separate status register read.
+ */
+#ifndef WIFI_GSPI_APPEND_STATUS
+#define WIFI_GSPI_APPEND_STATUS 1
+#endif
+
+/* gSPI command word fields and the F0 registers that control status
+ * reporting, as written by wwd_bus_init()
+ */
+#define GSPI_CMD_WRITE(cmd)    (((cmd) >> 31) & 1)
+#define GSPI_CMD_FUNCTION(cmd) (((cmd) >> 28) & 3)
+#define GSPI_CMD_ADDRESS(cmd)  (((cmd) >> 11) & 0x1FFFF)
+#define GSPI_CMD_LENGTH(cmd)   ((cmd) & 0x7FF)
+
+#define GSPI_F0_BUS_CONTROL   0x0000
+#define GSPI_F0_STATUS_ENABLE 0x0002
+#define GSPI_WORD_LENGTH_32   0x01 // In GSPI_F0_BUS_CONTROL
+#define GSPI_STATUS_ENABLE    0x01 // In GSPI_F0_STATUS_ENABLE
 
 /* XXX: there is mutual recursion in WICED/.../SPI/wwd_bus_protocol.c:
  * wwd_bus_transfer_bytes() calls wwd_read_register_value() and vice versa.
@@ -13,21 +38,278 @@
 
 // TODO: ensure GPIO_0 is used to select SPI mode - Add pull-up on SN8000 GPIO_0
 
+/* The WLAN chip starts in 16-bit mode without status reporting, and only
+ * appends the status word once wwd_bus_init() has switched both on
+ */
+static int spi_32bit = 0;
+static int spi_status_enabled = 0;
+
 wwd_result_t host_platform_bus_init() {
-  // SPI and GPIO (for IRQ line) components started from par, so already ready
+  // GPIO (for IRQ line) component started from par, so already ready.
+  // The SPI ports are configured once here rather than on every transfer.
+  xcore_wiced_spi_init();
+  spi_32bit = 0;
+  spi_status_enabled = 0;
   return WWD_SUCCESS;
 }
 
 wwd_result_t host_platform_bus_deinit() {
-  // No action needed
+  xcore_wiced_spi_deinit();
+  return WWD_SUCCESS;
+}
+
+// The TX buffer currently being sent by wwd_bus_send_buffer(), if any
+static wiced_buffer_t spi_tx_chain = NULL;
+
+static uint32_t spi_status_unknown = WIFI_GSPI_STATUS_UNKNOWN;
+static uint32_t spi_status_word;
+
+// Where the status word of the last transaction is read to
+static uint32_t* spi_status = &spi_status_unknown;
+
+uint32_t xcore_wiced_spi_last_status() {
+  // The last transaction may still be in progress on the SPI engine
+  xcore_wiced_spi_wait(0);
+  return *spi_status;
+}
+
+void xcore_wiced_spi_invalidate_status() {
+  spi_status = &spi_status_unknown;
+}
+
+static wifi_spi_direction_t spi_direction(wwd_bus_transfer_direction_t dir) {
+  return (dir == BUS_READ) ? WIFI_SPI_READ : WIFI_SPI_WRITE;
+}
+
+// In 16-bit mode each word goes over the bus with its halves swapped
+static uint32_t spi_word(const uint8_t* data) {
+  uint32_t word = data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+  return spi_32bit ? word : ((word << 16) | (word >> 16));
+}
+
+/* Follow the F0 register writes that switch on 32-bit mode and status
+ * reporting, so that the status word is only read once the chip sends it
+ */
+static void spi_snoop_control_write(const uint8_t* buffer,
+                                    unsigned buffer_length) {
+  if (buffer_length < 2 * sizeof(uint32_t)) {
+    return;
+  }
+  uint32_t cmd = spi_word(buffer);
+  unsigned address = GSPI_CMD_ADDRESS(cmd);
+  unsigned length = GSPI_CMD_LENGTH(cmd);
+  if (!GSPI_CMD_WRITE(cmd) || (GSPI_CMD_FUNCTION(cmd) != 0) ||
+      (address > GSPI_F0_STATUS_ENABLE) || (length > sizeof(uint32_t))) {
+    return;
+  }
+  uint32_t value = spi_word(&buffer[sizeof(uint32_t)]) << (8 * address);
+  int bus_control = (address == GSPI_F0_BUS_CONTROL);
+  int status_enable = (address + length > GSPI_F0_STATUS_ENABLE);
+
+  if (bus_control) {
+    spi_32bit = (value & GSPI_WORD_LENGTH_32) != 0;
+  }
+  if (status_enable) {
+    spi_status_enabled =
+        ((value >> (8 * GSPI_F0_STATUS_ENABLE)) & GSPI_STATUS_ENABLE) != 0;
+  }
+}
+
+/* Queue the read of the status word that follows the transaction into status,
+ * if the chip is sending one. The word is cleared first as the status read is
+ * a write of zeros.
+ */
+static void spi_add_status_read(wifi_spi_batch_t* batch, uint32_t* status) {
+#if WIFI_GSPI_APPEND_STATUS
+  if (spi_32bit && spi_status_enabled) {
+    *status = 0;
+    if (wifi_spi_batch_add(batch, (uint8_t*)status, sizeof(*status),
+                           WIFI_SPI_READ)) {
+      spi_status = status;
+      return;
+    }
+  }
+#endif
+  spi_status = &spi_status_unknown;
+}
+
+#if WIFI_SPI_ENGINE
+/* Writes of TX buffers are started on the SPI engine without waiting for them,
+ * so that the WWD thread can prepare the next frame while this one is on the
+ * wire. The engine is handed a pointer to the segments, which point straight
+ * into the buffer, and owns them and the buffer until it hands the segments
+ * back over its channel. A buffer released by the WWD driver in the meantime
+ * is only released once the engine is done with it. Up to two writes are in
+ * flight; reads and anything else that needs the bus wait for all of them.
+ *
+ * The engine's channel and these slots belong to whichever logical core is
+ * running the WWD driver: the interface task while wwd_management_init()
+ * brings up the bus, then the WWD thread. wwd_thread_init() waits for every
+ * write to complete before starting the WWD thread, so none is in flight
+ * across the hand-over.
+ */
+#define SPI_ENGINE_SLOTS 2
+
+typedef struct {
+  wifi_spi_batch_t batch;
+  uint32_t status;
+  wiced_buffer_t buffer; // The TX buffer being written
+  int release_pending;   // Released by the WWD driver while being written
+} spi_engine_slot_t;
+
+static spi_engine_slot_t spi_engine_slots[SPI_ENGINE_SLOTS];
+static unsigned spi_engine_oldest = 0;
+static unsigned spi_engine_outstanding = 0;
+
+// The slot the next write goes in, once the write before last has completed
+static spi_engine_slot_t* spi_engine_slot_next() {
+  xcore_wiced_spi_wait(SPI_ENGINE_SLOTS - 1);
+  unsigned index = spi_engine_oldest + spi_engine_outstanding;
+  return &spi_engine_slots[index % SPI_ENGINE_SLOTS];
+}
+
+static void spi_engine_write(spi_engine_slot_t* slot, wiced_buffer_t buffer) {
+  spi_add_status_read(&slot->batch, &slot->status);
+  slot->buffer = buffer;
+  slot->release_pending = 0;
+  xcore_wiced_spi_submit_segments(slot->batch.segments,
+                                  slot->batch.num_segments);
+  spi_engine_outstanding++;
+}
+
+int xcore_wiced_spi_release_later(wiced_buffer_t buffer) {
+  for (unsigned i = 0; i < spi_engine_outstanding; i++) {
+    spi_engine_slot_t* slot =
+        &spi_engine_slots[(spi_engine_oldest + i) % SPI_ENGINE_SLOTS];
+    if (slot->buffer == buffer) {
+      slot->release_pending = 1;
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif
+
+void xcore_wiced_spi_wait(unsigned max_outstanding) {
+#if WIFI_SPI_ENGINE
+  while (spi_engine_outstanding > max_outstanding) {
+    spi_engine_slot_t* slot = &spi_engine_slots[spi_engine_oldest];
+    wifi_spi_segment_t* segments = xcore_wiced_spi_engine_complete();
+    wiced_assert("SPI engine completed out of order",
+                 segments == slot->batch.segments);
+    spi_engine_oldest = (spi_engine_oldest + 1) % SPI_ENGINE_SLOTS;
+    spi_engine_outstanding--;
+
+    wiced_buffer_t buffer = slot->buffer;
+    int release = slot->release_pending;
+    slot->buffer = NULL;
+    slot->release_pending = 0;
+    if (release) {
+      host_buffer_release(buffer, WWD_NETWORK_TX);
+    }
+  }
+#endif
+}
+
+void xcore_wiced_spi_set_tx_chain(wiced_buffer_t buffer) {
+  spi_tx_chain = buffer;
+}
+
+/*
+ * The WWD bus layer treats a chained data packet as one piece of tot_len bytes
+ * (see host_buffer_get_current_piece_size()), but only the first piece is
+ * actually contiguous. Clock the rest of the chain out directly from each
+ * piece under the same CS assertion rather than copying it. Queues one segment
+ * per piece, and returns 0 if there are too many pieces for the batch.
+ */
+static int spi_add_chain(wifi_spi_batch_t* batch, wiced_buffer_t chain,
+                         uint8_t* buffer, uint16_t buffer_length) {
+  static uint8_t padding[4] = {0};
+  unsigned remaining = buffer_length;
+
+  // The bus layer points part way into the first piece, past its queue header
+  wiced_buffer_t piece = chain;
+  uint8_t* data = buffer;
+  unsigned piece_length = ((uint8_t*)piece->payload + piece->len) - buffer;
+
+  while (remaining > 0) {
+    unsigned length = MIN(piece_length, remaining);
+    if (!wifi_spi_batch_add(batch, data, length, WIFI_SPI_WRITE)) {
+      wiced_assert("Too many pieces in TX buffer chain", 0 != 0);
+      return 0;
+    }
+    remaining -= length;
+
+    if (piece != NULL) {
+      piece = piece->next;
+    }
+    if (piece != NULL) {
+      data = (uint8_t*)piece->payload;
+      piece_length = piece->len;
+    } else {
+      // The bus layer rounds transfers up to a whole number of words
+      data = padding;
+      piece_length = sizeof(padding);
+    }
+  }
+  return 1;
+}
+
+static wwd_result_t spi_write_tx_buffer(wiced_buffer_t tx_buffer,
+                                        uint8_t* buffer,
+                                        uint16_t buffer_length) {
+#if WIFI_SPI_ENGINE
+  spi_engine_slot_t* slot = spi_engine_slot_next();
+  wifi_spi_batch_t* batch = &slot->batch;
+#else
+  wifi_spi_batch_t local_batch;
+  wifi_spi_batch_t* batch = &local_batch;
+#endif
+
+  wifi_spi_batch_init(batch);
+  if (tx_buffer->flags & XCORE_WICED_PBUF_FLAG_TX_GATHER) {
+    if (!spi_add_chain(batch, tx_buffer, buffer, buffer_length)) {
+      return WWD_WLAN_ERROR;
+    }
+  } else {
+    wifi_spi_batch_add(batch, buffer, buffer_length, WIFI_SPI_WRITE);
+  }
+
+#if WIFI_SPI_ENGINE
+  spi_engine_write(slot, tx_buffer);
+#else
+  spi_add_status_read(batch, &spi_status_word);
+  xcore_wiced_spi_transfer_segments(batch->segments, batch->num_segments);
+#endif
   return WWD_SUCCESS;
 }
 
 wwd_result_t host_platform_spi_transfer(wwd_bus_transfer_direction_t dir,
                                         uint8_t* buffer,
                                         uint16_t buffer_length) {
+  WIFI_TRACE(SPI, WIFI_TRACE_PACKETS, WIFI_TRACE_SPI_TRANSFER, buffer_length);
+  xcore_wiced_stats_bus_transfer(buffer_length);
+
+  // The frame being sent lives in a TX buffer, so need not be waited for
+  if ((dir == BUS_WRITE) && (spi_tx_chain != NULL) &&
+      (buffer >= (uint8_t*)spi_tx_chain->payload) &&
+      (buffer < (uint8_t*)spi_tx_chain->payload + spi_tx_chain->len)) {
+    return spi_write_tx_buffer(spi_tx_chain, buffer, buffer_length);
+  }
+
+  // The command and payload are already together in the buffer
+  wifi_spi_batch_t batch;
+  wifi_spi_batch_init(&batch);
+  wifi_spi_batch_add(&batch, buffer, buffer_length, spi_direction(dir));
+  spi_add_status_read(&batch, &spi_status_word);
+
   // Must call an xC function to perform SPI transfer as lib_spi uses interfaces
-  xcore_wiced_spi_transfer(dir, buffer, buffer_length);
+  xcore_wiced_spi_transfer_segments(batch.segments, batch.num_segments);
+
+  // The status word follows the write that switches it on
+  if (dir == BUS_WRITE) {
+    spi_snoop_control_write(buffer, buffer_length);
+  }
   return WWD_SUCCESS;
 }
 
@@ -0,0 +1,88 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include "wwd_firmware_lz.h"
+#include <string.h>
+
+#define WINDOW_MASK (WIFI_LZ_WINDOW_SIZE - 1)
+
+// What the next input byte is
+enum {
+  STAGE_FLAGS,
+  STAGE_LITERAL,
+  STAGE_MATCH_LOW,
+  STAGE_MATCH_HIGH
+};
+
+uint32_t wifi_lz_image_size(const uint8_t header[WIFI_LZ_HEADER_SIZE]) {
+  if ((memcmp(header, WIFI_LZ_MAGIC, 4) != 0) ||
+      (header[8] != WIFI_LZ_WINDOW_BITS)) {
+    return 0;
+  }
+  return header[4] | (header[5] << 8) | (header[6] << 16) |
+         ((uint32_t)header[7] << 24);
+}
+
+void wifi_lz_init(wifi_lz_t *lz) {
+  // The window need not be cleared as matches never reach before the start
+  lz->position = 0;
+  lz->stage = STAGE_FLAGS;
+  lz->flags_left = 0;
+  lz->match_remaining = 0;
+}
+
+static void next_token(wifi_lz_t *lz) {
+  if (--lz->flags_left == 0) {
+    lz->stage = STAGE_FLAGS;
+  } else {
+    lz->flags >>= 1;
+    lz->stage = (lz->flags & 1) ? STAGE_LITERAL : STAGE_MATCH_LOW;
+  }
+}
+
+size_t wifi_lz_decompress(wifi_lz_t *lz,
+                          const uint8_t *in, size_t in_length, size_t *in_used,
+                          uint8_t *out, size_t out_length) {
+  size_t i = 0;
+  size_t o = 0;
+
+  while (o < out_length) {
+    if (lz->match_remaining) {
+      uint8_t b = lz->window[(lz->position - lz->match_distance) & WINDOW_MASK];
+      lz->window[lz->position++ & WINDOW_MASK] = b;
+      out[o++] = b;
+      lz->match_remaining--;
+      continue;
+    }
+    if (i == in_length) {
+      break;
+    }
+
+    uint8_t b = in[i++];
+    switch (lz->stage) {
+      case STAGE_FLAGS:
+        lz->flags = b;
+        lz->flags_left = 8;
+        lz->stage = (b & 1) ? STAGE_LITERAL : STAGE_MATCH_LOW;
+        break;
+
+      case STAGE_LITERAL:
+        lz->window[lz->position++ & WINDOW_MASK] = b;
+        out[o++] = b;
+        next_token(lz);
+        break;
+
+      case STAGE_MATCH_LOW:
+        lz->match_low = b;
+        lz->stage = STAGE_MATCH_HIGH;
+        break;
+
+      case STAGE_MATCH_HIGH:
+        lz->match_distance = (lz->match_low | ((b >> 4) << 8)) + 1;
+        lz->match_remaining = (b & 0xF) + WIFI_LZ_MIN_MATCH;
+        next_token(lz);
+        break;
+    }
+  }
+
+  *in_used = i;
+  return o;
+}
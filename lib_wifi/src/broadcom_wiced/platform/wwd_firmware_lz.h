@@ -0,0 +1,58 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#ifndef __wwd_firmware_lz_h__
+#define __wwd_firmware_lz_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Compressed WLAN firmware images, as written by compress_wifi_firmware.py.
+ *
+ * The file starts with a WIFI_LZ_HEADER_SIZE byte header:
+ *   0  "WFZ1"
+ *   4  size of the original image, 32 bit little endian
+ *   8  log2 of the window size, which must be WIFI_LZ_WINDOW_BITS
+ *   9  reserved, zero
+ *
+ * It is followed by LZSS tokens in groups of eight, each group preceded by a
+ * byte of flags, least significant bit first. A set flag is a literal byte.
+ * A clear flag is a two byte match of (length - WIFI_LZ_MIN_MATCH) in the
+ * low four bits of the second byte and (distance - 1) in the high four bits
+ * of the second byte and all of the first.
+ */
+
+#define WIFI_LZ_MAGIC       "WFZ1"
+#define WIFI_LZ_HEADER_SIZE 12
+#define WIFI_LZ_WINDOW_BITS 12
+#define WIFI_LZ_WINDOW_SIZE (1 << WIFI_LZ_WINDOW_BITS)
+#define WIFI_LZ_MIN_MATCH   3
+
+/** State of a decompression, which can be fed and drained in any amounts */
+typedef struct wifi_lz_t {
+  uint8_t window[WIFI_LZ_WINDOW_SIZE];
+  unsigned position;        ///< Bytes output so far
+  unsigned stage;
+  unsigned flags;
+  unsigned flags_left;
+  unsigned match_low;
+  unsigned match_distance;
+  unsigned match_remaining;
+} wifi_lz_t;
+
+/** Returns the size of the original image if header is that of a compressed
+ *  image, otherwise 0
+ */
+uint32_t wifi_lz_image_size(const uint8_t header[WIFI_LZ_HEADER_SIZE]);
+
+/** Start decompressing from the first token after the header */
+void wifi_lz_init(wifi_lz_t *lz);
+
+/** Decompress up to out_length bytes from in_length bytes of input.
+ *  The number of input bytes consumed is returned in in_used and the number
+ *  of bytes output is returned. Decompression stops when the output is full
+ *  or the input is exhausted, and carries on from there on the next call.
+ */
+size_t wifi_lz_decompress(wifi_lz_t *lz,
+                          const uint8_t *in, size_t in_length, size_t *in_used,
+                          uint8_t *out, size_t out_length);
+
+#endif // __wwd_firmware_lz_h__
@@ -0,0 +1,39 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include "wifi_broadcom_wiced.h"
+#include "wwd_assert.h"
+#include "wifi_nvram_image.h"
+#include "xassert.h"
+
+/* With WWD_DIRECT_RESOURCES set WWD downloads the firmware straight from the
+ * image linked into the application, wifi_firmware_image[], rather than
+ * reading it from the filesystem through wwd_resources.xc.
+ */
+#if WWD_DIRECT_RESOURCES
+
+wwd_result_t host_platform_resource_size(wwd_resource_t resource,
+                                         uint32_t* size_out) {
+  if (resource == WWD_RESOURCE_WLAN_FIRMWARE) {
+    *size_out = wifi_firmware_image_size;
+  } else if (resource == WWD_RESOURCE_WLAN_NVRAM) {
+    *size_out = sizeof(wifi_nvram_image);
+  } else {
+    fail("Unknown resource type requested\n");
+    return WWD_BADARG;
+  }
+  return WWD_SUCCESS;
+}
+
+wwd_result_t host_platform_resource_read_direct(wwd_resource_t resource,
+                                                const void** ptr_out) {
+  if (resource == WWD_RESOURCE_WLAN_FIRMWARE) {
+    *ptr_out = wifi_firmware_image;
+  } else if (resource == WWD_RESOURCE_WLAN_NVRAM) {
+    *ptr_out = wifi_nvram_image;
+  } else {
+    fail("Unknown resource type requested\n");
+    return WWD_BADARG;
+  }
+  return WWD_SUCCESS;
+}
+
+#endif // WWD_DIRECT_RESOURCES
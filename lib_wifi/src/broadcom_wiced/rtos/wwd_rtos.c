@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <time.h>
 #include <timer.h>
+#include <xs1.h>
 
 // TODO: Ensure assertions can be disabled, define debug unit here?
 #include "xassert.h"
@@ -45,8 +46,8 @@ wwd_result_t host_rtos_finish_thread(host_thread_type_t* thread) {
    * it will instead enter a deinitialised waiting state (ready to restart
    * the WWD when required).
    *
-   * wwd_thread_func() will send a signal via a channel to indicate when it has
-   * stopped, rather than calling this function.
+   * wwd_thread_func() will set a semaphore to indicate when it has stopped,
+   * rather than calling this function.
    */
    fail("Trying to finish an RTOS thread!");
 
@@ -56,9 +57,9 @@ wwd_result_t host_rtos_finish_thread(host_thread_type_t* thread) {
 wwd_result_t host_rtos_join_thread(host_thread_type_t* thread) {
   /* The logical core (thread) running WWD will not join when the task is
    * stopped, it will enter a deinitialised waiting state instead.
-   * Upon entry to this state, it will send a 'stopped' signal.
+   * Upon entry to this state, it will set a 'stopped' semaphore.
    *
-   * wwd_thread_func() will send a signal via a channel directly, rather than
+   * wwd_thread_quit() will wait on that semaphore directly, rather than
    * calling this function.
    */
 
@@ -71,96 +72,104 @@ wwd_result_t host_rtos_delete_terminated_thread(host_thread_type_t* thread) {
   return WWD_SUCCESS;
 }
 
-// TODO: move semaphores to lib_locks
-// The hardware lock is declared in newlib's lock.h module.
-extern unsigned __libc_hwlock;
-
-static inline void hwlock_acquire()
-{
-  __asm__ __volatile__ ("in %0, res[%0]"
-                        : /* no output */
-                        : "r" (__libc_hwlock)
-                        : "memory");
+/*
+ * The semaphores share one hardware lock, which is only held while a count is
+ * checked and updated, so that they do not contend with newlib for
+ * __libc_hwlock. There are too few hardware locks for one per semaphore.
+ * A logical core that has to wait adds itself to the semaphore's waiters and
+ * sleeps on a channel end connected to itself, which the next set of the
+ * semaphore sends a control token to. Each logical core only waits on one
+ * semaphore at a time, so the channel ends belong to the cores rather than to
+ * the semaphores.
+ */
+#define XCORE_WWD_MAX_LOGICAL_CORES 8
+
+static unsigned core_chanends[XCORE_WWD_MAX_LOGICAL_CORES];
+
+// Only called by the logical core itself, so its entry needs no lock
+static unsigned core_chanend(unsigned core) {
+  if (core_chanends[core] == 0) {
+    unsigned c;
+    asm volatile ("getr %0, %1"
+                  : "=r" (c)
+                  : "n" (XS1_RES_TYPE_CHANEND));
+    xassert(c && msg("No semaphore chanend available"));
+    asm volatile ("setd res[%0], %0"
+                  : /* no output */
+                  : "r" (c));
+    core_chanends[core] = c;
+  }
+  return core_chanends[core];
 }
 
-static inline void hwlock_release()
-{
-  __asm__ __volatile__ ("out res[%0], %0"
-                        : /* no output */
-                        : "r" (__libc_hwlock)
-                        : "memory");
-}
+int semaphore_increment(host_semaphore_type_t* semaphore, unsigned max_count) {
+  unsigned waiter = XCORE_WWD_MAX_LOGICAL_CORES;
 
-static bool conditional_increment(host_semaphore_type_t* ptr, unsigned max) {
-  bool success = false;
-  hwlock_acquire();
-  int tmp = *ptr;
-  if (tmp < max) {
-    *ptr = tmp + 1;
-    success = true;
+  hwlock_acquire(xcore_wiced_lock);
+  if (semaphore->count >= max_count) {
+    hwlock_release(xcore_wiced_lock);
+    return 0;
   }
-  hwlock_release();
-  return success;
-}
-
-static bool conditional_decrement(host_semaphore_type_t* ptr, unsigned min) {
-  bool success = false;
-  hwlock_acquire();
-  int tmp = *ptr;
-  if (tmp > min) {
-    *ptr = tmp - 1;
-    success = true;
+  semaphore->count++;
+  if (semaphore->waiters) {
+    waiter = __builtin_ctz(semaphore->waiters);
+    semaphore->waiters &= ~(1 << waiter);
   }
-  hwlock_release();
-  return success;
-}
+  hwlock_release(xcore_wiced_lock);
 
-int semaphore_increment(host_semaphore_type_t* semaphore,
-                         unsigned max_count,
-                         unsigned timeout_ms) {
-  clock_t current_time, exit_time;
-
-  exit_time = clock();
-  exit_time += (timeout_ms * XS1_TIMER_KHZ); // Scale timeout up to timer ticks
-  while (!conditional_increment(semaphore, max_count)) {
-    if (timeout_ms == 0) {
-      return 0; // Fail immediately
-    } else {
-      delay_microseconds(1); // Yield processing power
-      current_time = clock();
-      if (((int)(exit_time - current_time) < 0) &&
-          (timeout_ms != NEVER_TIMEOUT)) {
-        return 0; // Timed out
-      }
-    }
+  if (waiter != XCORE_WWD_MAX_LOGICAL_CORES) {
+    asm volatile ("outct res[%0], %1"
+                  : /* no output */
+                  : "r" (core_chanends[waiter]), "r" (XS1_CT_END));
   }
   return 1;
 }
 
 static bool semaphore_decrement(host_semaphore_type_t* semaphore,
-                                unsigned min_count,
                                 unsigned timeout_ms) {
-  clock_t current_time, exit_time;
+  unsigned core = get_logical_core_id();
+  unsigned c = 0;
+  clock_t exit_time;
 
   exit_time = clock();
   exit_time += (timeout_ms * XS1_TIMER_KHZ); // Scale timeout up to timer ticks
-  while (!conditional_decrement(semaphore, min_count)) {
+  if (timeout_ms != 0) {
+    c = core_chanend(core);
+  }
+
+  while (1) {
+    hwlock_acquire(xcore_wiced_lock);
+    if (semaphore->count > 0) {
+      semaphore->count--;
+      hwlock_release(xcore_wiced_lock);
+      return true;
+    }
     if (timeout_ms == 0) {
+      hwlock_release(xcore_wiced_lock);
       return false; // Fail immediately
-    } else {
-      delay_microseconds(1); // Yield processing power
-      current_time = clock();
-      if (((int)(exit_time - current_time) < 0) &&
-          (timeout_ms != NEVER_TIMEOUT)) {
-        return false; // Timed out
+    }
+    semaphore->waiters |= (1 << core);
+    hwlock_release(xcore_wiced_lock);
+
+    if (!xcore_wwd_semaphore_wait(c, exit_time,
+                                  timeout_ms == NEVER_TIMEOUT)) {
+      // Timed out, unless the semaphore was set in the meantime
+      hwlock_acquire(xcore_wiced_lock);
+      int notified = !(semaphore->waiters & (1 << core));
+      semaphore->waiters &= ~(1 << core);
+      hwlock_release(xcore_wiced_lock);
+      if (!notified) {
+        return false;
       }
+      // Take the token that has been sent so it does not wake a later wait
+      xcore_wwd_semaphore_wait(c, 0, 1);
     }
   }
-  return true;
 }
 
 wwd_result_t host_rtos_init_semaphore(host_semaphore_type_t* semaphore) {
-  *semaphore = WIFI_BCM_WWD_SEMAPHORE_INIT_VAL;
+  semaphore->count = WIFI_BCM_WWD_SEMAPHORE_INIT_VAL;
+  semaphore->waiters = 0;
   return WWD_SUCCESS;
 }
 
@@ -169,8 +178,7 @@ extern host_semaphore_type_t wwd_transceive_semaphore;
 wwd_result_t host_rtos_get_semaphore(host_semaphore_type_t* semaphore,
                                      uint32_t timeout_ms,
                                      wiced_bool_t will_set_in_isr) {
-  if (semaphore_decrement(semaphore, WIFI_BCM_WWD_SEMAPHORE_INIT_VAL,
-                          timeout_ms)) {
+  if (semaphore_decrement(semaphore, timeout_ms)) {
     // XXX: special case to handle wwd_transceive_semaphore reaching zero?
     return WWD_SUCCESS;
   } else {
@@ -180,7 +188,7 @@ wwd_result_t host_rtos_get_semaphore(host_semaphore_type_t* semaphore,
 
 wwd_result_t host_rtos_set_semaphore(host_semaphore_type_t* semaphore,
                                      wiced_bool_t called_from_ISR) {
-  if (semaphore_increment(semaphore, WIFI_BCM_WWD_SEMAPHORE_MAX_VAL, 0)) {
+  if (semaphore_increment(semaphore, WIFI_BCM_WWD_SEMAPHORE_MAX_VAL)) {
     /* Special handling of wwd_transceive_semaphore to cause the xcore_wwd()
      * task to event when this semaphore is set
      */
@@ -194,19 +202,40 @@ wwd_result_t host_rtos_set_semaphore(host_semaphore_type_t* semaphore,
 }
 
 wwd_result_t host_rtos_deinit_semaphore(host_semaphore_type_t* semaphore) {
-  // No structures to free
+  // No structures to free, the channel ends belong to the logical cores
+  xassert((semaphore->waiters == 0) && msg("Semaphore deleted while waited on"));
   return WWD_SUCCESS;
 }
 
-host_semaphore_type_t host_rtos_semaphore_value(host_semaphore_type_t* semaphore) {
-  return *semaphore;
+unsigned host_rtos_semaphore_value(host_semaphore_type_t* semaphore) {
+  return semaphore->count;
 }
 
 extern unsigned xcore_get_ticks();
 
+/* The reference timer wraps about every 42.9 s, so the wraps are counted to
+ * keep the time in ms going up. The driver's interface task calls
+ * xcore_wiced_clock_update() often enough that none is missed.
+ */
+static unsigned clock_last_ticks = 0;
+static unsigned clock_wraps = 0;
+
 wwd_time_t host_rtos_get_time() {
+  hwlock_acquire(xcore_wiced_lock);
+  unsigned ticks = xcore_get_ticks();
+  if (ticks < clock_last_ticks) {
+    clock_wraps++;
+  }
+  clock_last_ticks = ticks;
+  uint64_t total_ticks = ((uint64_t)clock_wraps << 32) | ticks;
+  hwlock_release(xcore_wiced_lock);
+
   // Convert ticks to ms
-  return (wwd_time_t)(xcore_get_ticks() / 100000);
+  return (wwd_time_t)(total_ticks / XS1_TIMER_KHZ);
+}
+
+void xcore_wiced_clock_update() {
+  host_rtos_get_time();
 }
 
 wwd_result_t host_rtos_delay_milliseconds(uint32_t num_ms) {
@@ -15,7 +15,14 @@
 #define WIFI_BCM_WWD_SEMAPHORE_INIT_VAL (0) // TODO: document
 #define WIFI_BCM_WWD_SEMAPHORE_MAX_VAL (UINT8_MAX) // TODO: document
 
-typedef unsigned char host_semaphore_type_t; // FIXME: this was just created as a place holder
+/** A counting semaphore. The fields are protected by xcore_wiced_lock and a
+ *  logical core waiting for the count to be non-zero sleeps on a channel end
+ *  of its own until the semaphore is set.
+ */
+typedef struct {
+  unsigned count;
+  unsigned waiters; ///< Bit mask of the logical cores waiting
+} host_semaphore_type_t;
 typedef unsigned char host_thread_type_t; // FIXME: this was just created as a place holder
 typedef unsigned char host_queue_type_t; // FIXME: this was just created as a place holder
 
@@ -3,16 +3,30 @@
 #define __wifi_broadcom_wiced_h__
 
 #include "xc2compat.h"
+#include <xccompat.h>
 #include <stdint.h>
+#include "wifi.h"
 #include "xc_broadcom_wiced_includes.h"
+#include "wifi_spi.h"
 #include "gpio.h"
+#include "hwlock.h"
+#include "xcore_wwd_signals.h"
+#include "xcore_rx_ring.h"
 
-/** TODO: document (brief) */
-typedef enum {
-  XCORE_WWD_START,              ///< TODO: document (brief)
-  XCORE_WWD_STOPPED,            ///< TODO: document (brief)
-  XCORE_WWD_SEMAPHORE_INCREMENT ///< TODO: document (brief)
-} xcore_wwd_control_signal_t;
+/** Run SPI transfers on a separate SPI engine task. Uses an extra logical core
+ *  but lets the WWD thread overlap protocol processing with bus transfers.
+ */
+#ifndef WIFI_SPI_ENGINE
+#define WIFI_SPI_ENGINE 0
+#endif
+
+/** Run the WWD thread on the same logical core as the driver's interface
+ *  task. Saves a logical core and hands received packets straight to the
+ *  interface task, but a long control request then holds up the bus.
+ */
+#ifndef WIFI_COMBINED_TASK
+#define WIFI_COMBINED_TASK 0
+#endif
 
 /** TODO: document (brief) */
 unsafe void xcore_wiced_drive_power_line (uint32_t line_state);
@@ -20,45 +34,280 @@ unsafe void xcore_wiced_drive_power_line (uint32_t line_state);
 /** TODO: document (brief) */
 unsafe void xcore_wiced_drive_reset_line(uint32_t line_state);
 
+/** Bring up the WLAN chip with wwd_management_init(), downloading the
+ *  firmware with its read buffers on this function's stack
+ */
+wwd_result_t xcore_wiced_management_init();
+
+/** Configure the SPI ports ready for bus transfers */
+unsafe void xcore_wiced_spi_init();
+
+/** Release the SPI ports so they are reconfigured on the next init */
+unsafe void xcore_wiced_spi_deinit();
+
 /** TODO: document (brief) */
 unsafe void xcore_wiced_spi_transfer(wwd_bus_transfer_direction_t direction,
                                      uint8_t * unsafe buffer,
                                      uint16_t buffer_length);
 
-/** TODO: document (brief) */
-void xcore_wwd_send_control_signal(xcore_wwd_control_signal_t signal_to_send);
+/** Transfer a list of segments under a single CS assertion */
+unsafe void xcore_wiced_spi_transfer_segments(
+    wifi_spi_segment_t * unsafe segments,
+    unsigned num_segments);
+
+/** Start a transfer of a list of segments under a single CS assertion. With
+ *  WIFI_SPI_ENGINE the transfer is performed by the SPI engine task, which
+ *  owns the segments and the data they point to until
+ *  xcore_wiced_spi_engine_complete() hands the segments back. Otherwise the
+ *  transfer is complete on return.
+ */
+unsafe void xcore_wiced_spi_submit_segments(
+    wifi_spi_segment_t * unsafe segments,
+    unsigned num_segments);
+
+/** Wait for the oldest transfer submitted to the SPI engine, returning the
+ *  segments it was submitted with
+ */
+unsafe wifi_spi_segment_t * unsafe xcore_wiced_spi_engine_complete();
+
+/** Wait until no more than max_outstanding writes started on the SPI engine
+ *  are still to complete, releasing any TX buffers they held on to
+ */
+unsafe void xcore_wiced_spi_wait(unsigned max_outstanding);
+
+/** Returns non-zero if a TX buffer is still being written by the SPI engine,
+ *  in which case it is released once the write has completed rather than now
+ */
+int xcore_wiced_spi_release_later(wiced_buffer_t buffer);
+
+/** gSPI status word bits, as appended to each transaction by the WLAN chip */
+#define WIFI_GSPI_STATUS_F2_RX_READY         (1 << 5)
+#define WIFI_GSPI_STATUS_F2_PACKET_AVAILABLE (1 << 8)
+#define WIFI_GSPI_STATUS_F2_PACKET_LENGTH(status) (((status) >> 9) & 0x7FF)
+
+/** Value of xcore_wiced_spi_last_status() when no status is held */
+#define WIFI_GSPI_STATUS_UNKNOWN 0xFFFFFFFF
+
+/** Get the gSPI status word read at the end of the most recent bus
+ *  transaction, or WIFI_GSPI_STATUS_UNKNOWN if it may be out of date.
+ */
+uint32_t xcore_wiced_spi_last_status();
+
+/** Forget the held gSPI status, e.g. when the WLAN may have changed state */
+void xcore_wiced_spi_invalidate_status();
+
+/** Register the TX buffer about to be sent by wwd_bus_send_buffer() so that
+ *  a chained buffer can be transferred without being copied. Cleared with NULL.
+ */
+void xcore_wiced_spi_set_tx_chain(wiced_buffer_t buffer);
+
+/** Hardware lock shared by the WWD RTOS semaphores and buffer partitions. It
+ *  is only ever held for a few instructions.
+ */
+extern hwlock_t xcore_wiced_lock;
+
+/** Wait for a control token on a channel end connected to itself, until the
+ *  reference timer passes exit_time unless forever is set. Returns 0 if it
+ *  timed out.
+ */
+int xcore_wwd_semaphore_wait(streaming_chanend_t c, unsigned exit_time,
+                             int forever);
+
+/** Read the clock behind host_rtos_get_time() so that it counts a wrap of
+ *  the reference timer. Must be called at least every
+ *  XCORE_WICED_CLOCK_UPDATE_MS.
+ */
+#define XCORE_WICED_CLOCK_UPDATE_MS 20000
+void xcore_wiced_clock_update();
 
 /** TODO: document (brief) */
 xcore_wwd_control_signal_t xcore_wwd_receive_control_signal();
 
 void xcore_wiced_send_pbuf_to_internal(wiced_buffer_t p);
 
-#if __XC__
+/** Tell the interface task that there are new scan results or a scan has
+ *  ended. Only called again once the event has been taken.
+ */
+void xcore_wiced_send_scan_event_to_internal();
 
-#include "hwlock.h"
+/** Whether a WWD buffer was taken from the control partition. Data packets
+ *  read into one are dropped so that it is soon free for control traffic.
+ */
+int xcore_wiced_buffer_is_control(wiced_buffer_t p);
+
+/** Whether reading has stopped until an RX or control buffer is freed */
+int xcore_wiced_buffers_rx_starved();
+
+/** pbuf flag marking a data packet counted in the TX queue */
+#define XCORE_WICED_PBUF_FLAG_TX_QUEUED 0x80
+
+/** pbuf flag marking a chained data packet that the SPI layer gathers from
+ *  its pieces, so that WWD sizes it by the whole chain
+ */
+#define XCORE_WICED_PBUF_FLAG_TX_GATHER 0x40
+
+/** Result of counting a data packet into the TX queue */
+typedef enum {
+  XCORE_WICED_TX_RESERVED,       ///< Counted in, so pass it to the WWD driver
+  XCORE_WICED_TX_ALREADY_QUEUED, ///< Still waiting to be sent, so leave it
+  XCORE_WICED_TX_QUEUE_FULL      ///< The queue is full, so drop it
+} xcore_wiced_tx_reserve_t;
+
+/** Count a data packet into the TX queue before passing it to the WWD driver.
+ *  A packet already in the queue, as for a TCP retransmission of a segment
+ *  not yet sent, must not be passed to the driver again.
+ */
+xcore_wiced_tx_reserve_t xcore_wiced_tx_queue_reserve(wiced_buffer_t p);
 
-/**
- * A structure for storing notification signals for the xcore_wwd.
- * It is empty when head == tail.
+/** Count a packet out of the TX queue when the WWD driver releases it */
+void xcore_wiced_tx_queue_release(wiced_buffer_t p);
+
+/** Count a failure to get a buffer, or a packet dropped from a control buffer.
+ *  Takes xcore_wiced_lock.
+ */
+void xcore_wiced_stats_pbuf_alloc_failure();
+
+/** Count a packet received or sent through the netif with WIFI_DIRECT_NETIF,
+ *  or dropped by a full TX queue. Each takes xcore_wiced_lock.
+ */
+void xcore_wiced_stats_netif_rx(unsigned bytes);
+void xcore_wiced_stats_netif_tx(unsigned bytes);
+void xcore_wiced_stats_netif_tx_drop();
+
+/** Count a poke of the WLAN while it has no SDPCM credits */
+void xcore_wiced_stats_credit_stall();
+
+/** Note that the WLAN has SDPCM credits again */
+void xcore_wiced_stats_credits_available();
+
+/** Add a latency in timer ticks to a histogram of WIFI_LATENCY_BINS bins */
+void xcore_wiced_stats_add_latency(unsigned histogram[], unsigned ticks);
+
+/** Record the time in timer ticks taken to load the firmware file and the
+ *  number of filesystem reads that took
+ */
+void xcore_wiced_stats_firmware_loaded(unsigned ticks, unsigned fs_reads);
+
+/** Count a bus transfer of a number of bytes, and a wake of the bus if it
+ *  was asleep
+ */
+void xcore_wiced_stats_bus_transfer(unsigned bytes);
+
+/** Count the bus being allowed to sleep */
+void xcore_wiced_stats_bus_sleep();
+
+/** Returns non-zero if the bus has been allowed to sleep and not used since */
+int xcore_wiced_bus_asleep();
+
+/** Number of packets passed to the WWD driver that it has not yet sent */
+unsigned xcore_wiced_tx_queue_count();
+
+/** Fill in the bus, credit and queue state of a hardware status. The radio
+ *  and link state are left zeroed for the interface task.
+ */
+void xcore_wiced_hardware_status_get(
+    REFERENCE_PARAM(wifi_hardware_status_t, status));
+
+/** Set the bus power policy used by the WWD thread */
+void xcore_wwd_set_bus_policy(wifi_bus_power_policy_t policy,
+                              unsigned idle_timeout_ms);
+
+/** Get the bus power policy used by the WWD thread */
+wifi_bus_power_policy_t xcore_wwd_get_bus_policy(
+    REFERENCE_PARAM(unsigned, idle_timeout_ms));
+
+/** Whether the WWD thread is polling the bus or waiting for interrupts */
+typedef struct xcore_wwd_poll_t {
+  unsigned polling;       ///< Non-zero while polling
+  unsigned last_irq_time;
+  unsigned busy_irqs;     ///< Interrupts in a row with short gaps between
+  unsigned idle_polls;    ///< Polls in a row that found no frames
+} xcore_wwd_poll_t;
+
+/** Start by waiting for interrupts */
+void xcore_wwd_poll_init(REFERENCE_PARAM(xcore_wwd_poll_t, poll));
+
+/** Note an interrupt at a time in timer ticks. Returns non-zero to switch
+ *  to polling.
+ */
+int xcore_wwd_poll_irq(REFERENCE_PARAM(xcore_wwd_poll_t, poll),
+                       unsigned time);
+
+/** Note the number of frames read by a poll. Returns non-zero to carry on
+ *  polling, or zero to go back to waiting for interrupts.
  */
-#define NUM_SIGNALS 10
-typedef struct {
-  xcore_wwd_control_signal_t signals[NUM_SIGNALS];
-  unsigned head;
-  unsigned tail;
-  hwlock_t lock;
-  unsigned notification_chanend;
-} signals_t;
+int xcore_wwd_poll_polled(REFERENCE_PARAM(xcore_wwd_poll_t, poll),
+                          unsigned frames);
+
+/** Copy out the statistics counted outside the interface task */
+void xcore_wiced_stats_get(REFERENCE_PARAM(wifi_stats_t, stats));
+
+/** Zero the statistics counted outside the interface task */
+void xcore_wiced_stats_reset();
 
-xcore_wwd_control_signal_t signals_take(signals_t &signals);
-int signals_put(signals_t &signals, xcore_wwd_control_signal_t signal);
-int signals_is_empty(signals_t &signals);
+/** Time of the event that led to the frames currently being read */
+unsigned xcore_wiced_rx_start_time();
+
+#ifndef __XC__
+/** Statistics updated directly by the C parts of the driver */
+extern wifi_stats_t xcore_wiced_stats;
+#endif
+
+#if __XC__
 
 /** TODO: document (brief) */
 [[combinable]]
 void xcore_wwd(client interface input_gpio_if i_irq,
                streaming chanend notification_chanend);
 
+/* The events xcore_wwd() handles, also handled by the interface task when it
+ * runs the WWD thread itself with WIFI_COMBINED_TASK.
+ */
+
+/** Handle the signals sent with xcore_wwd_send_control_signal() */
+void xcore_wwd_handle_signals();
+
+/** Handle the IRQ, which the caller has configured to event again */
+void xcore_wwd_handle_irq();
+
+/** Poll the bus at the time given by xcore_wwd_poll_time() */
+void xcore_wwd_handle_poll();
+
+/** Put the bus to sleep at the time given by xcore_wwd_bus_sleep_time() */
+void xcore_wwd_handle_bus_sleep();
+
+/** Whether the IRQ is to be waited for */
+int xcore_wwd_irq_wanted();
+
+/** Whether the bus is being polled */
+int xcore_wwd_poll_wanted();
+
+/** Time at which the bus is next due to be polled */
+unsigned xcore_wwd_poll_time();
+
+/** Whether the bus is waiting to sleep */
+int xcore_wwd_bus_sleep_wanted();
+
+/** Time at which the bus is due to sleep */
+unsigned xcore_wwd_bus_sleep_time();
+
+#if WIFI_COMBINED_TASK
+/** Start running the WWD thread on the calling logical core. Semaphore waits
+ *  made on it from then on handle WWD events until they end.
+ */
+void xcore_wwd_combined_init(client interface input_gpio_if i_irq,
+                             streaming chanend notification_chanend);
+
+/** Whether a semaphore wait on the calling logical core must handle WWD
+ *  events, being on the combined task and not within the WWD thread
+ */
+int xcore_wwd_waits_handle_events();
+
+/** As xcore_wwd_semaphore_wait(), handling WWD events until the wait ends */
+int xcore_wwd_wait_handling_events(streaming chanend c, unsigned exit_time,
+                                   int forever);
+#endif
+
 #endif // __XC__
 
 #endif // __wifi_broadcom_wiced_h__
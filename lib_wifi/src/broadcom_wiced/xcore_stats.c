@@ -0,0 +1,110 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include "wifi_broadcom_wiced.h"
+#include "wifi.h"
+#include <string.h>
+#include <xs1.h>
+
+/* Statistics counted outside the interface task. The bus, credit, poll and
+ * latency counters each have a single writer, the WWD thread or whichever
+ * logical core owns the bus, so are updated without a lock. Buffer allocation
+ * failures and the packet counters of the netif are counted from more than
+ * one logical core, so are only updated under xcore_wiced_lock, as are copies
+ * and resets of the whole set.
+ */
+wifi_stats_t xcore_wiced_stats;
+
+static unsigned credit_stalled = 0;
+static unsigned bus_asleep = 0;
+
+void xcore_wiced_stats_pbuf_alloc_failure() {
+  hwlock_acquire(xcore_wiced_lock);
+  xcore_wiced_stats.pbuf_alloc_failures++;
+  hwlock_release(xcore_wiced_lock);
+}
+
+void xcore_wiced_stats_netif_rx(unsigned bytes) {
+  hwlock_acquire(xcore_wiced_lock);
+  xcore_wiced_stats.rx_frames++;
+  xcore_wiced_stats.rx_bytes += bytes;
+  hwlock_release(xcore_wiced_lock);
+}
+
+void xcore_wiced_stats_netif_tx(unsigned bytes) {
+  hwlock_acquire(xcore_wiced_lock);
+  xcore_wiced_stats.tx_frames++;
+  xcore_wiced_stats.tx_bytes += bytes;
+  hwlock_release(xcore_wiced_lock);
+}
+
+void xcore_wiced_stats_netif_tx_drop() {
+  hwlock_acquire(xcore_wiced_lock);
+  xcore_wiced_stats.tx_queue_drops++;
+  hwlock_release(xcore_wiced_lock);
+}
+
+void xcore_wiced_stats_credit_stall() {
+  if (!credit_stalled) {
+    credit_stalled = 1;
+    xcore_wiced_stats.credit_stalls++;
+  }
+  xcore_wiced_stats.bus_pokes++;
+}
+
+void xcore_wiced_stats_credits_available() {
+  credit_stalled = 0;
+}
+
+void xcore_wiced_stats_bus_transfer(unsigned bytes) {
+  xcore_wiced_stats.spi_transactions++;
+  xcore_wiced_stats.spi_bytes += bytes;
+  if (bus_asleep) {
+    bus_asleep = 0;
+    xcore_wiced_stats.bus_wakes++;
+  }
+}
+
+void xcore_wiced_stats_bus_sleep() {
+  bus_asleep = 1;
+  xcore_wiced_stats.bus_sleeps++;
+}
+
+int xcore_wiced_bus_asleep() {
+  return bus_asleep;
+}
+
+void xcore_wiced_hardware_status_get(wifi_hardware_status_t *status) {
+  memset(status, 0, sizeof(wifi_hardware_status_t));
+  status->bus_asleep = bus_asleep;
+  status->credit_stalled = credit_stalled;
+  status->rx_paused = xcore_wiced_rx_paused();
+  status->tx_queued = xcore_wiced_tx_queue_count();
+}
+
+void xcore_wiced_stats_add_latency(unsigned histogram[WIFI_LATENCY_BINS],
+                                   unsigned ticks) {
+  unsigned limit = WIFI_LATENCY_BIN_US * XS1_TIMER_MHZ;
+  unsigned bin = 0;
+
+  while ((bin < WIFI_LATENCY_BINS - 1) && (ticks >= limit)) {
+    limit <<= 1;
+    bin++;
+  }
+  histogram[bin]++;
+}
+
+void xcore_wiced_stats_firmware_loaded(unsigned ticks, unsigned fs_reads) {
+  xcore_wiced_stats.firmware_load_us = ticks / XS1_TIMER_MHZ;
+  xcore_wiced_stats.firmware_fs_reads = fs_reads;
+}
+
+void xcore_wiced_stats_get(wifi_stats_t *stats) {
+  hwlock_acquire(xcore_wiced_lock);
+  memcpy(stats, &xcore_wiced_stats, sizeof(wifi_stats_t));
+  hwlock_release(xcore_wiced_lock);
+}
+
+void xcore_wiced_stats_reset() {
+  hwlock_acquire(xcore_wiced_lock);
+  memset(&xcore_wiced_stats, 0, sizeof(wifi_stats_t));
+  hwlock_release(xcore_wiced_lock);
+}
@@ -1,16 +1,32 @@
 // Copyright (c) 2015-2017, XMOS Ltd, All rights reserved
 #include "wifi.h"
+#include "wifi_broadcom_wiced.h"
 #include "wwd_events.h"
 #include "wwd_wifi.h"
 #include "wwd_debug.h"
 #include "wwd_structures.h"
+#include "wwd_rtos_interface.h"
 #include <stddef.h>
 #include "xassert.h"
 #include "debug_print.h"
 #include <string.h>
-#include "timer.h"
 
-static int scan_active = 0;
+/* Scans run in the background, with the scan results handled by the WWD
+ * thread. The interface task is sent one event at a time, which it
+ * acknowledges before looking at the results, so that the WWD thread can
+ * never block sending it another.
+ */
+static volatile wifi_scan_state_t scan_state = WIFI_SCAN_IDLE;
+static volatile int scan_event_pending = 0;
+
+/* Set at the end of each scan for scan_for_networks() to wait on. Zero
+ * initialised, as host_rtos_init_semaphore() would leave it.
+ */
+static host_semaphore_type_t scan_done_semaphore;
+
+// Set while a directed probe for a single network is running
+static volatile int probe_running = 0;
+static host_semaphore_type_t probe_done_semaphore;
 
 void* wwd_scan_result_handler(const wwd_event_header_t* event_header,
                               const uint8_t* event_data,
@@ -82,44 +98,170 @@ void print_scan_result( wiced_scan_result_t *record )
     WPRINT_APP_INFO( ( "\n" ) );
 }
 
+/* The scan table is written by the WWD thread as results arrive, and read by
+ * the interface task while a scan is running, so both hold xcore_wiced_lock.
+ * Results are copied out under the lock rather than used in place.
+ */
 static wiced_scan_result_t scan_results[WIFI_MAX_SCAN_RESULTS];
-static int record_count;
+static wwd_time_t scan_last_seen[WIFI_MAX_SCAN_RESULTS];
+static volatile int record_count;
 static wwd_time_t scan_start_time;
 
-// FIXME: give this a proper return type when there is no match
-int find_duplicate_scan_result(wiced_scan_result_t *result_ptr) {
-  for (int i = 0; i < record_count; i++) {
-    // Check if all octets of BSSID match
-    if (memcmp(result_ptr->BSSID.octet, scan_results[i].BSSID.octet,
-               sizeof(wiced_mac_t))) {
-      continue;
+// The WWD driver writes each result here before passing it to the handler
+static wiced_scan_result_t scan_incoming;
+
+/* Results are found by a hash of BSSID and channel. Each bucket holds the
+ * index of the first result in its chain, linked through scan_hash_next[].
+ * Only the chains are relinked when a result is replaced: every result keeps
+ * its index in scan_results[], which clients pass to join_network_by_index().
+ */
+#if (WIFI_SCAN_HASH_BUCKETS & (WIFI_SCAN_HASH_BUCKETS - 1)) != 0
+#error "WIFI_SCAN_HASH_BUCKETS must be a power of two"
+#endif
+
+#define SCAN_HASH_NONE (-1)
+static int16_t scan_hash_heads[WIFI_SCAN_HASH_BUCKETS];
+static int16_t scan_hash_next[WIFI_MAX_SCAN_RESULTS];
+
+static void scan_notify() {
+  if (!scan_event_pending) {
+    scan_event_pending = 1;
+    xcore_wiced_send_scan_event_to_internal();
+  }
+}
+
+static void scan_finished(wifi_scan_state_t state) {
+  scan_state = state;
+  host_rtos_set_semaphore(&scan_done_semaphore, WICED_FALSE);
+  scan_notify();
+}
+
+static unsigned scan_hash(const wiced_scan_result_t *result) {
+  // FNV-1a
+  unsigned hash = 2166136261u;
+  for (int i = 0; i < sizeof(wiced_mac_t); i++) {
+    hash = (hash ^ result->BSSID.octet[i]) * 16777619u;
+  }
+  hash = (hash ^ result->channel) * 16777619u;
+  return hash & (WIFI_SCAN_HASH_BUCKETS - 1);
+}
+
+static void scan_index_clear() {
+  for (int i = 0; i < WIFI_SCAN_HASH_BUCKETS; i++) {
+    scan_hash_heads[i] = SCAN_HASH_NONE;
+  }
+}
+
+static int scan_index_find(const wiced_scan_result_t *result) {
+  int i = scan_hash_heads[scan_hash(result)];
+  while (i != SCAN_HASH_NONE) {
+    if ((scan_results[i].channel == result->channel) &&
+        (memcmp(scan_results[i].BSSID.octet, result->BSSID.octet,
+                sizeof(wiced_mac_t)) == 0)) {
+      return i;
     }
-    // if they do, check if it's on the same band
-    if (result_ptr->band != scan_results[i].band) {
-      continue;
+    i = scan_hash_next[i];
+  }
+  return SCAN_HASH_NONE;
+}
+
+static void scan_index_insert(int index) {
+  unsigned bucket = scan_hash(&scan_results[index]);
+  scan_hash_next[index] = scan_hash_heads[bucket];
+  scan_hash_heads[bucket] = index;
+}
+
+static void scan_index_remove(int index) {
+  int16_t *link = &scan_hash_heads[scan_hash(&scan_results[index])];
+  while (*link != index) {
+    xassert(*link != SCAN_HASH_NONE);
+    link = &scan_hash_next[*link];
+  }
+  *link = scan_hash_next[index];
+}
+
+/* The result to replace when the table is full: the one heard longest ago if
+ * that was over WIFI_SCAN_MAX_AGE_MS ago, otherwise the one with the weakest
+ * signal. Sets stale if the result is out of date.
+ */
+static int scan_victim(wwd_time_t now, int *stale) {
+  int oldest = 0;
+  int weakest = 0;
+  for (int i = 1; i < record_count; i++) {
+    // By age, as the times wrap once host_rtos_get_time() reaches its limit
+    if (now - scan_last_seen[i] > now - scan_last_seen[oldest]) {
+      oldest = i;
     }
-    // if it is, check if the channel is the same
-    if (result_ptr->channel != scan_results[i].channel) {
-      continue;
+    if (scan_results[i].signal_strength < scan_results[weakest].signal_strength) {
+      weakest = i;
     }
-    // if it is, check if SSID matches
-    if ((result_ptr->SSID.length != scan_results[i].SSID.length) ||
-        (memcmp(result_ptr->SSID.value, scan_results[i].SSID.value,
-                 scan_results[i].SSID.length))) {
-      continue;
+  }
+  *stale = (now - scan_last_seen[oldest] > WIFI_SCAN_MAX_AGE_MS);
+  return *stale ? oldest : weakest;
+}
+
+/* Add a result heard at now to the table, or update the one for the same
+ * BSSID and channel. Returns whether the table changed.
+ */
+static int scan_result_add(const wiced_scan_result_t *result,
+                           wwd_time_t now) {
+  if (record_count == 0) {
+    scan_index_clear();
+  }
+  int index = scan_index_find(result);
+
+  if (index != SCAN_HASH_NONE) {
+    wiced_scan_result_t *existing = &scan_results[index];
+    existing->signal_strength = result->signal_strength;
+    existing->max_data_rate = result->max_data_rate;
+    if ((existing->SSID.length == 0) && (result->SSID.length != 0)) {
+      // A hidden network has been named by a probe response
+      existing->SSID = result->SSID;
     }
-    // if it does, check the network type matches - warn if not?
-    if (result_ptr->bss_type != scan_results[i].bss_type) {
-      continue;
+  } else if (record_count < WIFI_MAX_SCAN_RESULTS) {
+    index = record_count;
+    scan_results[index] = *result;
+    scan_index_insert(index);
+    ++record_count;
+  } else {
+    // Replace in place so that no other result moves
+    int stale;
+    index = scan_victim(now, &stale);
+    if (!stale &&
+        (result->signal_strength <= scan_results[index].signal_strength)) {
+      return 0;
     }
-    // if it does, check the security type matches
-    if (result_ptr->security != scan_results[i].security) {
-      continue;
+    scan_index_remove(index);
+    scan_results[index] = *result;
+    scan_index_insert(index);
+  }
+  scan_last_seen[index] = now;
+  return 1;
+}
+
+/* Copy out the strongest network with this name heard within
+ * WIFI_SCAN_MAX_AGE_MS. Returns 0 if there is none.
+ */
+static int scan_find_ssid(const wiced_ssid_t *ssid,
+                          wiced_scan_result_t *network) {
+  wwd_time_t now = host_rtos_get_time();
+  const wiced_scan_result_t *found = NULL;
+
+  hwlock_acquire(xcore_wiced_lock);
+  for (int i = 0; i < record_count; i++) {
+    const wiced_scan_result_t *entry = &scan_results[i];
+    if ((now - scan_last_seen[i] <= WIFI_SCAN_MAX_AGE_MS) &&
+        (entry->SSID.length == ssid->length) &&
+        (memcmp(ssid->value, entry->SSID.value, ssid->length) == 0) &&
+        ((found == NULL) || (entry->signal_strength > found->signal_strength))) {
+      found = entry;
     }
-    // Return index of duplicate
-    return i;
   }
-  return -1; // No match found
+  if (found != NULL) {
+    *network = *found;
+  }
+  hwlock_release(xcore_wiced_lock);
+  return (found != NULL);
 }
 
 /*
@@ -129,24 +271,21 @@ void scan_result_handler(wiced_scan_result_t **result_ptr,
                          wiced_scan_status_t status) {
   if (result_ptr != NULL) {
     if (status == WICED_SCAN_INCOMPLETE) {
-      int dup_index = find_duplicate_scan_result(*result_ptr);
-      if (dup_index != -1) {
-        // TODO: update the max data rate, signal strength
-        // Clear duplicate
-        memset(*result_ptr, 0, sizeof(wiced_scan_result_t));
-        // FIXME: clears the last valid result if WIFI_MAX_SCAN_RESULTS is reached
-        return;
-      }
-      ++record_count;
-      if (record_count < WIFI_MAX_SCAN_RESULTS) {
-        // Bump results_ptr on to point at the next element of scan_results
-        *result_ptr = &scan_results[record_count];
-      } else if (record_count == WIFI_MAX_SCAN_RESULTS) {
-        debug_printf("Aborting scan as maximum number of results reached\n");
-        wwd_wifi_abort_scan(); // TODO: check return code
-        scan_active = 0;
+      // Read before taking the lock, which host_rtos_get_time() also takes
+      wwd_time_t now = host_rtos_get_time();
+      hwlock_acquire(xcore_wiced_lock);
+      int changed = scan_result_add(*result_ptr, now);
+      hwlock_release(xcore_wiced_lock);
+      // Probe responses are kept without disturbing the scan's clients
+      if (changed && !probe_running) {
+        scan_notify();
       }
+      // Reuse the same slot for the next result
+      memset(*result_ptr, 0, sizeof(wiced_scan_result_t));
     }
+  } else if (probe_running) {
+    probe_running = 0;
+    host_rtos_set_semaphore(&probe_done_semaphore, WICED_FALSE);
   } else {
     wwd_time_t scan_end_time = host_rtos_get_time();
     debug_printf("\nScan %s %d milliseconds\n",
@@ -156,7 +295,10 @@ void scan_result_handler(wiced_scan_result_t **result_ptr,
       WPRINT_APP_INFO(("%3d ", i));
       print_scan_result(&scan_results[i]);
     }
-    scan_active = 0;
+    if (scan_state == WIFI_SCAN_RUNNING) {
+      scan_finished((status == WICED_SCAN_COMPLETED_SUCCESSFULLY) ?
+                    WIFI_SCAN_COMPLETE : WIFI_SCAN_ABORTED);
+    }
   }
 }
 
@@ -180,46 +322,401 @@ void scan_result_callback_wrapper(
 
 wiced_scan_result_t *scan_result_ptr;
 
-size_t xcore_wifi_scan_networks() {
-  // Clear any previous scan results
-  memset(&scan_results, 0, sizeof(wiced_scan_result_t)*record_count);
-  record_count = 0;
-  scan_result_ptr = &scan_results[record_count];
+int xcore_wifi_scan_start() {
+  if (scan_state == WIFI_SCAN_RUNNING) {
+    return 0;
+  }
+
+  // Results are kept from earlier scans, with the time each was last heard
+  memset(&scan_incoming, 0, sizeof(scan_incoming));
+  scan_result_ptr = &scan_incoming;
   scan_start_time = host_rtos_get_time();
 
-  scan_active = 1;
-  wwd_wifi_scan( WICED_SCAN_TYPE_ACTIVE, WICED_BSS_TYPE_ANY, NULL, NULL,
-    NULL, NULL, CALLBACK_SCAN_RESULT_FUNC, &scan_result_ptr,
-    NULL, WWD_STA_INTERFACE);
+  scan_state = WIFI_SCAN_RUNNING;
+  if (wwd_wifi_scan( WICED_SCAN_TYPE_ACTIVE, WICED_BSS_TYPE_ANY, NULL, NULL,
+        NULL, NULL, CALLBACK_SCAN_RESULT_FUNC, &scan_result_ptr,
+        NULL, WWD_STA_INTERFACE) != WWD_SUCCESS) {
+    scan_state = WIFI_SCAN_ABORTED;
+    return 0;
+  }
+  return 1;
+}
+
+static void scan_wait() {
+  while (scan_state == WIFI_SCAN_RUNNING) {
+    host_rtos_get_semaphore(&scan_done_semaphore, NEVER_TIMEOUT, WICED_FALSE);
+  }
+}
 
-  while (scan_active) {
-    delay_microseconds(10);
+/* Stop a background scan so that a join can go ahead without waiting for it.
+ * Its clients see it end as WIFI_SCAN_ABORTED.
+ */
+static void scan_abort() {
+  if (scan_state == WIFI_SCAN_RUNNING) {
+    wwd_wifi_abort_scan();
   }
+}
+
+size_t xcore_wifi_scan_networks() {
+  // Forget scans that ended while nothing was waiting for them
+  while (host_rtos_get_semaphore(&scan_done_semaphore, 0, WICED_FALSE) ==
+         WWD_SUCCESS);
+
+  // Wait for the end of a background scan if one is running
+  xcore_wifi_scan_start();
+  scan_wait();
   return record_count;
 }
 
-int xcore_wifi_get_network_index(const char *name) {
-  size_t name_length = strlen(name);
-  for (int i = 0; i < record_count; i++) {
-    if ((scan_results[i].SSID.length == name_length) &&
-        (memcmp(name, scan_results[i].SSID.value, scan_results[i].SSID.length) == 0)) {
-      return i;
+/* Probe for a single network by name. The responses are added to the scan
+ * table without notifying its clients.
+ */
+static void scan_probe(const wiced_ssid_t *ssid) {
+  static wiced_scan_result_t probe_incoming;
+  static wiced_scan_result_t *probe_result_ptr;
+
+  memset(&probe_incoming, 0, sizeof(probe_incoming));
+  probe_result_ptr = &probe_incoming;
+
+  probe_running = 1;
+  if (wwd_wifi_scan(WICED_SCAN_TYPE_ACTIVE, WICED_BSS_TYPE_ANY, ssid, NULL,
+        NULL, NULL, CALLBACK_SCAN_RESULT_FUNC, &probe_result_ptr,
+        NULL, WWD_STA_INTERFACE) != WWD_SUCCESS) {
+    probe_running = 0;
+    return;
+  }
+  host_rtos_get_semaphore(&probe_done_semaphore, NEVER_TIMEOUT, WICED_FALSE);
+}
+
+wifi_scan_state_t xcore_wifi_scan_event_taken(size_t *num_results) {
+  // Clear first so that any later results cause another event
+  scan_event_pending = 0;
+  *num_results = record_count;
+  return scan_state;
+}
+
+wifi_scan_state_t xcore_wifi_scan_state(size_t *num_results) {
+  *num_results = record_count;
+  return scan_state;
+}
+
+// Copy out a result from the table. Returns 0 if index is not in the table.
+static int scan_result_get(size_t index, wiced_scan_result_t *result,
+                           wwd_time_t *last_seen) {
+  hwlock_acquire(xcore_wiced_lock);
+  int valid = (index < record_count);
+  if (valid) {
+    *result = scan_results[index];
+    *last_seen = scan_last_seen[index];
+  }
+  hwlock_release(xcore_wiced_lock);
+  return valid;
+}
+
+int xcore_wifi_get_scan_result(size_t index, wifi_network_info_t *info) {
+  wiced_scan_result_t result;
+  wwd_time_t last_seen;
+  if (!scan_result_get(index, &result, &last_seen)) {
+    return 0;
+  }
+  memset(info, 0, sizeof(wifi_network_info_t));
+  info->ssid_length = MIN(result.SSID.length, WIFI_SSID_MAX_LENGTH);
+  memcpy(info->ssid, result.SSID.value, info->ssid_length);
+  memcpy(info->bssid, result.BSSID.octet, sizeof(info->bssid));
+  info->signal_strength = result.signal_strength;
+  info->channel = result.channel;
+  info->security = result.security;
+  info->bss_type = result.bss_type;
+  info->max_data_rate = result.max_data_rate;
+  info->last_seen = last_seen;
+  return 1;
+}
+
+/* The network last joined, kept in WIFI_PROFILE_FILENAME so that it can be
+ * rejoined on its BSSID and channel without scanning, even after a reboot.
+ */
+#define WIFI_PROFILE_MAGIC 0x57504631 // "WPF1"
+
+typedef struct wifi_profile_t {
+  uint32_t magic;
+  wiced_ssid_t ssid;
+  wiced_mac_t bssid;
+  uint8_t channel;
+  uint8_t band;
+  uint32_t security;
+  uint32_t checksum;
+} wifi_profile_t;
+
+// Profile file access, see wwd_profile.xc
+int xcore_wifi_profile_read(uint8_t *data, size_t size);
+int xcore_wifi_profile_write(const uint8_t *data, size_t size);
+
+static wifi_profile_t profile;
+static int profile_read = 0;
+
+// Kept for rejoining after the link is lost, but never written to the file
+static wiced_ssid_t rejoin_ssid;
+static uint8_t rejoin_key[WIFI_MAX_KEY_LENGTH];
+static size_t rejoin_key_length;
+static int joined = 0;
+
+/* A lost link is first rejoined directly on the BSSID and channel in the
+ * profile, which is quickest when the access point is still there. Failing
+ * that it is rejoined without holding up the interface task: a background
+ * scan looks for the network and when it ends the strongest access point heard
+ * is joined. After each failed attempt the next waits twice as long, up to
+ * WIFI_LINK_REJOIN_MAX_BACKOFF_MS.
+ */
+typedef enum {
+  LINK_UP,       ///< Joined, or there is nothing to rejoin
+  LINK_SCANNING, ///< Waiting for the end of a scan to rejoin
+  LINK_BACKOFF   ///< Waiting to scan again after failing to rejoin
+} link_state_t;
+
+static link_state_t link_state = LINK_UP;
+static unsigned link_backoff_ms;
+
+/* An SSID as a string for printing. The SSID is only NUL terminated when it is
+ * shorter than its buffer, so is copied up to its length.
+ */
+static const char *ssid_string(const wiced_ssid_t *ssid,
+                               char str[SSID_NAME_SIZE + 1]) {
+  size_t length = MIN(ssid->length, SSID_NAME_SIZE);
+  memcpy(str, ssid->value, length);
+  str[length] = '\0';
+  return str;
+}
+
+static uint32_t profile_checksum(const wifi_profile_t *p) {
+  // FNV-1a of everything before the checksum
+  const uint8_t *bytes = (const uint8_t *)p;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < offsetof(wifi_profile_t, checksum); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static const wifi_profile_t *profile_get() {
+  if (!profile_read) {
+    profile_read = 1;
+    if (!xcore_wifi_profile_read((uint8_t *)&profile, sizeof(profile)) ||
+        (profile.magic != WIFI_PROFILE_MAGIC) ||
+        (profile.checksum != profile_checksum(&profile))) {
+      memset(&profile, 0, sizeof(profile));
+    }
+  }
+  return (profile.magic == WIFI_PROFILE_MAGIC) ? &profile : NULL;
+}
+
+static void profile_save(const wiced_ssid_t *ssid, wiced_security_t security) {
+  wifi_profile_t joined_profile;
+  uint32_t channel = 0;
+
+  memset(&joined_profile, 0, sizeof(joined_profile));
+  joined_profile.magic = WIFI_PROFILE_MAGIC;
+  joined_profile.ssid = *ssid;
+  joined_profile.security = security;
+  if ((wwd_wifi_get_bssid(&joined_profile.bssid) != WWD_SUCCESS) ||
+      (wwd_wifi_get_channel(WWD_STA_INTERFACE, &channel) != WWD_SUCCESS)) {
+    return;
+  }
+  joined_profile.channel = channel;
+  joined_profile.band = (channel <= 14) ? WICED_802_11_BAND_2_4GHZ :
+                                          WICED_802_11_BAND_5GHZ;
+  joined_profile.checksum = profile_checksum(&joined_profile);
+
+  // Save flash wear when rejoining the same access point
+  if (memcmp(&joined_profile, &profile, sizeof(profile)) != 0) {
+    profile = joined_profile;
+    profile_read = 1;
+    if (!xcore_wifi_profile_write((const uint8_t *)&profile, sizeof(profile))) {
+      debug_printf("Failed to save connection profile\n");
+    }
+  }
+}
+
+static unsigned join_succeeded(const wiced_ssid_t *ssid,
+                               wiced_security_t security,
+                               const uint8_t security_key[],
+                               size_t key_length) {
+  rejoin_ssid = *ssid;
+  memmove(rejoin_key, security_key, key_length); // May be rejoin_key
+  rejoin_key_length = key_length;
+  joined = 1;
+  profile_save(ssid, security);
+  return WWD_SUCCESS;
+}
+
+// Join the access point in the profile directly on its channel
+static unsigned join_profile(const wiced_ssid_t *ssid,
+                             uint8_t security_key[], size_t key_length) {
+  const wifi_profile_t *p = profile_get();
+  wiced_scan_result_t ap;
+
+  if ((p == NULL) || (p->ssid.length != ssid->length) ||
+      (memcmp(p->ssid.value, ssid->value, ssid->length) != 0)) {
+    return WWD_NETWORK_NOT_FOUND;
+  }
+  memset(&ap, 0, sizeof(ap));
+  ap.SSID = p->ssid;
+  ap.BSSID = p->bssid;
+  ap.channel = p->channel;
+  ap.band = p->band;
+  ap.security = p->security;
+  ap.bss_type = WICED_BSS_TYPE_INFRASTRUCTURE;
+  return wwd_wifi_join_specific(&ap, security_key, key_length, NULL,
+                                WWD_STA_INTERFACE);
+}
+
+static unsigned join_ssid(const wiced_ssid_t *ssid,
+                          uint8_t security_key[], size_t key_length) {
+  char name[SSID_NAME_SIZE + 1];
+  joined = 0;
+  link_state = LINK_UP;
+
+  // Rather than hold up the interface task, and with it the data, until a
+  // background scan ends
+  scan_abort();
+
+  unsigned result = join_profile(ssid, security_key, key_length);
+  if (result == WWD_SUCCESS) {
+    debug_printf("Joined %s from profile\n", ssid_string(ssid, name));
+    return join_succeeded(ssid, profile.security, security_key, key_length);
+  }
+
+  wiced_scan_result_t ap;
+  if (!scan_find_ssid(ssid, &ap)) {
+    debug_printf("%s not heard recently, probing\n",
+                 ssid_string(ssid, name));
+    scan_probe(ssid);
+    if (!scan_find_ssid(ssid, &ap)) {
+      debug_printf("Network %s not found\n", ssid_string(ssid, name));
+      return WWD_NETWORK_NOT_FOUND;
     }
   }
-  return -1;
+
+  // Join the access point that was heard, on its channel, without scanning
+  result = wwd_wifi_join_specific(&ap, security_key, key_length, NULL,
+                                  WWD_STA_INTERFACE);
+  debug_printf("Join result = %d\n", result);
+  if (result == WWD_SUCCESS) {
+    return join_succeeded(&ap.SSID, ap.security, security_key, key_length);
+  }
+  return result;
+}
+
+unsigned xcore_wifi_join_network_by_name(const char *name,
+                                         uint8_t security_key[],
+                                         size_t key_length) {
+  wiced_ssid_t ssid;
+  memset(&ssid, 0, sizeof(ssid));
+  ssid.length = MIN(strlen(name), sizeof(ssid.value) - 1);
+  memcpy(ssid.value, name, ssid.length);
+  return join_ssid(&ssid, security_key, key_length);
 }
 
 unsigned xcore_wifi_join_network_at_index(size_t index,
                                       uint8_t security_key[],
                                       size_t key_length) {
-  wiced_scan_result_t *scan_result_ptr = &scan_results[index];
-  unsigned result = wwd_wifi_join(&scan_result_ptr->SSID,
-                                  scan_result_ptr->security,
+  wiced_scan_result_t network;
+  wwd_time_t last_seen;
+  if (!scan_result_get(index, &network, &last_seen)) {
+    return WWD_NETWORK_NOT_FOUND;
+  }
+  joined = 0;
+  link_state = LINK_UP;
+  unsigned result = wwd_wifi_join(&network.SSID, network.security,
                                   security_key, key_length, NULL);
   debug_printf("Join result = %d\n", result);
+  if (result == WWD_SUCCESS) {
+    return join_succeeded(&network.SSID, network.security,
+                          security_key, key_length);
+  }
   return result;
 }
 
+#if WIFI_LINK_REJOIN_MAX_BACKOFF_MS > 20000
+#error "WIFI_LINK_REJOIN_MAX_BACKOFF_MS must be at most 20000, as a timer cannot wait longer"
+#endif
+
+// Wait before scanning again, backing off further next time
+static unsigned link_rejoin_failed() {
+  unsigned delay_ms = link_backoff_ms;
+  link_backoff_ms = MIN(2 * link_backoff_ms, WIFI_LINK_REJOIN_MAX_BACKOFF_MS);
+  link_state = LINK_BACKOFF;
+  return delay_ms;
+}
+
+// Start a scan to look for the network, or join one already running
+static unsigned link_rejoin_scan() {
+  if (!xcore_wifi_scan_start() && (scan_state != WIFI_SCAN_RUNNING)) {
+    return link_rejoin_failed();
+  }
+  link_state = LINK_SCANNING;
+  return WIFI_LINK_CHECK_PERIOD_MS;
+}
+
+unsigned xcore_wifi_link_check() {
+  char name[SSID_NAME_SIZE + 1];
+
+  switch (link_state) {
+    case LINK_UP:
+      if (!joined ||
+          (wwd_wifi_is_ready_to_transceive(WWD_STA_INTERFACE) == WWD_SUCCESS)) {
+        return WIFI_LINK_CHECK_PERIOD_MS;
+      }
+      debug_printf("Link to %s lost, rejoining\n",
+                   ssid_string(&rejoin_ssid, name));
+      joined = 0;
+      if (join_profile(&rejoin_ssid, rejoin_key, rejoin_key_length) ==
+          WWD_SUCCESS) {
+        debug_printf("Rejoined %s from profile\n",
+                     ssid_string(&rejoin_ssid, name));
+        join_succeeded(&rejoin_ssid, profile.security, rejoin_key,
+                       rejoin_key_length);
+        return WIFI_LINK_CHECK_PERIOD_MS;
+      }
+      link_backoff_ms = WIFI_LINK_CHECK_PERIOD_MS;
+      return link_rejoin_scan();
+
+    case LINK_SCANNING:
+      // Moved on by the end of the scan
+      return WIFI_LINK_CHECK_PERIOD_MS;
+
+    case LINK_BACKOFF:
+    default:
+      return link_rejoin_scan();
+  }
+}
+
+int xcore_wifi_link_up() {
+  return joined &&
+         (wwd_wifi_is_ready_to_transceive(WWD_STA_INTERFACE) == WWD_SUCCESS);
+}
+
+unsigned xcore_wifi_link_scan_ended() {
+  char name[SSID_NAME_SIZE + 1];
+
+  if (link_state != LINK_SCANNING) {
+    return 0;
+  }
+  wiced_scan_result_t ap;
+  if (scan_find_ssid(&rejoin_ssid, &ap)) {
+    if (wwd_wifi_join_specific(&ap, rejoin_key, rejoin_key_length, NULL,
+                               WWD_STA_INTERFACE) == WWD_SUCCESS) {
+      debug_printf("Rejoined %s\n", ssid_string(&ap.SSID, name));
+      link_state = LINK_UP;
+      join_succeeded(&ap.SSID, ap.security, rejoin_key, rejoin_key_length);
+      return WIFI_LINK_CHECK_PERIOD_MS;
+    }
+  }
+  unsigned delay_ms = link_rejoin_failed();
+  debug_printf("Failed to rejoin %s, retrying in %d ms\n",
+               ssid_string(&rejoin_ssid, name), delay_ms);
+  return delay_ms;
+}
+
 wwd_result_t xcore_wifi_get_radio_mac_address(wiced_mac_t *mac_address) {
   return wwd_wifi_get_mac_address(mac_address, WWD_STA_INTERFACE);
 }
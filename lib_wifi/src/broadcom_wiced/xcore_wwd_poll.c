@@ -0,0 +1,44 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include "wifi_broadcom_wiced.h"
+#include "wifi.h"
+#include <xs1.h>
+
+/* Under sustained receive load the WWD thread polls the bus, which saves an
+ * IRQ event, re-arming the IRQ and a semaphore round trip per burst. It goes
+ * back to waiting for interrupts once the polls stop finding frames.
+ */
+
+#define ENTER_GAP_TICKS (WIFI_POLL_ENTER_GAP_US * XS1_TIMER_MHZ)
+
+void xcore_wwd_poll_init(xcore_wwd_poll_t *poll) {
+  poll->polling = 0;
+  poll->busy_irqs = 0;
+  poll->idle_polls = 0;
+}
+
+int xcore_wwd_poll_irq(xcore_wwd_poll_t *poll, unsigned time) {
+  if ((poll->busy_irqs != 0) && (time - poll->last_irq_time <= ENTER_GAP_TICKS)) {
+    poll->busy_irqs++;
+  } else {
+    poll->busy_irqs = 1;
+  }
+  poll->last_irq_time = time;
+
+  if ((WIFI_POLL_ENTER_IRQS != 0) && (poll->busy_irqs >= WIFI_POLL_ENTER_IRQS)) {
+    poll->polling = 1;
+    poll->busy_irqs = 0;
+    poll->idle_polls = 0;
+    xcore_wiced_stats.poll_mode_entries++;
+  }
+  return poll->polling;
+}
+
+int xcore_wwd_poll_polled(xcore_wwd_poll_t *poll, unsigned frames) {
+  xcore_wiced_stats.polls++;
+  if (frames != 0) {
+    poll->idle_polls = 0;
+  } else if (++poll->idle_polls >= WIFI_POLL_EXIT_IDLE_POLLS) {
+    poll->polling = 0;
+  }
+  return poll->polling;
+}
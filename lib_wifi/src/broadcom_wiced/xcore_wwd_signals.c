@@ -0,0 +1,41 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include "xcore_wwd_signals.h"
+
+/* The words are shared between logical cores, so are only accessed through
+ * volatile pointers.
+ */
+#define PENDING(signals, signal) (((volatile unsigned *)(signals)->pending)[signal])
+#define NOTIFIED(signals) (*(volatile unsigned *)&(signals)->notified)
+
+void signals_clear(signals_t *signals) {
+  for (unsigned i = 0; i < XCORE_WWD_NUM_SIGNALS; i++) {
+    PENDING(signals, i) = 0;
+  }
+  NOTIFIED(signals) = 0;
+}
+
+int signals_put(signals_t *signals, xcore_wwd_control_signal_t signal) {
+  PENDING(signals, signal) = 1;
+  XCORE_WWD_SIGNALS_BARRIER();
+
+  // A notification on its way will be taken after this signal was put
+  if (NOTIFIED(signals)) {
+    return 0;
+  }
+  NOTIFIED(signals) = 1;
+  return 1;
+}
+
+void signals_notified(signals_t *signals) {
+  NOTIFIED(signals) = 0;
+  XCORE_WWD_SIGNALS_BARRIER();
+}
+
+int signals_take(signals_t *signals, xcore_wwd_control_signal_t signal) {
+  if (!PENDING(signals, signal)) {
+    return 0;
+  }
+  // Put again from here on, it is handled after the next notification
+  PENDING(signals, signal) = 0;
+  return 1;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#ifndef __xcore_wwd_signals_h__
+#define __xcore_wwd_signals_h__
+
+#include <xccompat.h>
+
+/** TODO: document (brief) */
+typedef enum {
+  XCORE_WWD_START,              ///< TODO: document (brief)
+  XCORE_WWD_SEMAPHORE_INCREMENT, ///< TODO: document (brief)
+  XCORE_WWD_RX_RESUME,           ///< Space in the RX ring, so read the bus
+  XCORE_WWD_BUS_POLICY,          ///< The bus power policy has changed
+  XCORE_WWD_NUM_SIGNALS
+} xcore_wwd_control_signal_t;
+
+/**
+ * The control signals waiting to be taken by the logical core running the
+ * WWD thread. Each signal has a word of its own, set by any logical core and
+ * cleared by the one taking it, so no lock is needed and a signal sent again
+ * before it has been taken is only taken once. There is nothing to overflow.
+ *
+ * A notification is sent to notification_chanend when a signal is put and
+ * none is already on its way. Two logical cores putting signals at the same
+ * time may both send one, so the receiver discards any further notifications
+ * waiting before it calls signals_notified().
+ */
+typedef struct {
+  unsigned pending[XCORE_WWD_NUM_SIGNALS];
+  unsigned notified; ///< Set while a notification is waiting to be taken
+  unsigned notification_chanend;
+} signals_t;
+
+/** Stores by one logical core are seen by the others in order on the xCORE,
+ *  which has no store buffer. Hosts which reorder stores and loads need
+ *  this defined to a full memory barrier.
+ */
+#ifndef XCORE_WWD_SIGNALS_BARRIER
+#define XCORE_WWD_SIGNALS_BARRIER()
+#endif
+
+/** Clear all signals. The notification channel end is left alone */
+void signals_clear(REFERENCE_PARAM(signals_t, signals));
+
+/** Put a signal. Returns whether a notification has to be sent */
+int signals_put(REFERENCE_PARAM(signals_t, signals),
+                xcore_wwd_control_signal_t signal);
+
+/** Note that a notification has been received. Must be called before taking
+ *  the signals it was sent for, so that one put meanwhile sends another.
+ */
+void signals_notified(REFERENCE_PARAM(signals_t, signals));
+
+/** Take a signal. Returns whether it had been put */
+int signals_take(REFERENCE_PARAM(signals_t, signals),
+                 xcore_wwd_control_signal_t signal);
+
+/** Put a signal and notify the logical core running the WWD thread. Defined
+ *  in xcore_wwd.xc.
+ */
+void xcore_wwd_send_control_signal(xcore_wwd_control_signal_t signal_to_send);
+
+#endif // __xcore_wwd_signals_h__
@@ -0,0 +1,118 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include "wifi_trace.h"
+#include <xs1.h>
+#include <print.h>
+#if WIFI_TRACE_XSCOPE
+#include <xscope.h>
+#endif
+
+#if (WIFI_TRACE_RING_SIZE & (WIFI_TRACE_RING_SIZE - 1)) != 0
+#error "WIFI_TRACE_RING_SIZE must be a power of two"
+#endif
+
+extern unsigned xcore_get_ticks();
+
+/* Events are recorded from several logical cores. Each one has its own ring,
+ * which only it writes, so recording takes no lock and never holds up the
+ * data path on another core.
+ */
+#define TRACE_CORES 8
+
+static wifi_trace_entry_t trace_rings[TRACE_CORES][WIFI_TRACE_RING_SIZE];
+static volatile unsigned trace_counts[TRACE_CORES]; // Events recorded by each
+
+static const char * const trace_event_names[WIFI_TRACE_NUM_EVENTS] = {
+  "SPI transfer",
+  "SPI engine submit",
+  "SDPCM IRQ",
+  "SDPCM TX",
+  "SDPCM RX",
+  "SDPCM credit stall",
+  "SDPCM bus sleep",
+  "Buffer alloc fail",
+  "RX ring drop",
+  "RX ring pause",
+  "TX queue full",
+  "RX buffers starved",
+  "Data drop",
+  "Init radio",
+  "Scan",
+  "Join",
+  "Data RX",
+  "Data RX taken",
+  "Data TX",
+};
+
+void wifi_trace_record(wifi_trace_event_t event, uint32_t arg) {
+  unsigned core = get_logical_core_id();
+  unsigned count = trace_counts[core];
+  wifi_trace_entry_t *entry =
+      &trace_rings[core][count & (WIFI_TRACE_RING_SIZE - 1)];
+  entry->timestamp = xcore_get_ticks();
+  entry->event = event;
+  entry->arg = arg;
+  asm volatile("" ::: "memory"); // Only count the entry once it is written
+  trace_counts[core] = count + 1;
+
+#if WIFI_TRACE_XSCOPE
+  xscope_bytes(WIFI_TRACE_XSCOPE_PROBE, sizeof(*entry),
+               (unsigned char *)entry);
+#endif
+}
+
+/* Copy out an event a core recorded, returning 0 if the core may have been
+ * overwriting it while it was copied
+ */
+static int trace_copy(unsigned core, unsigned index,
+                      wifi_trace_entry_t *entry) {
+  *entry = trace_rings[core][index & (WIFI_TRACE_RING_SIZE - 1)];
+  asm volatile("" ::: "memory");
+  return (trace_counts[core] - index) < WIFI_TRACE_RING_SIZE;
+}
+
+static void trace_print(const wifi_trace_entry_t *entry) {
+  printuint(entry->timestamp);
+  printstr(" ");
+  if (entry->event < WIFI_TRACE_NUM_EVENTS) {
+    printstr(trace_event_names[entry->event]);
+  } else {
+    printuint(entry->event);
+  }
+  printstr(" ");
+  printhexln(entry->arg);
+}
+
+void wifi_trace_dump() {
+  unsigned next[TRACE_CORES]; // Index of each core's oldest event not printed
+  unsigned end[TRACE_CORES];
+
+  for (unsigned core = 0; core < TRACE_CORES; core++) {
+    end[core] = trace_counts[core];
+    next[core] = (end[core] > WIFI_TRACE_RING_SIZE) ?
+                 end[core] - WIFI_TRACE_RING_SIZE : 0;
+  }
+
+  // Merge the rings, printing the oldest event of any core each time
+  while (1) {
+    wifi_trace_entry_t oldest;
+    int oldest_core = -1;
+    for (unsigned core = 0; core < TRACE_CORES; core++) {
+      wifi_trace_entry_t entry;
+      while ((next[core] < end[core]) &&
+             !trace_copy(core, next[core], &entry)) {
+        next[core]++; // Overwritten by the core since the dump started
+      }
+      if ((next[core] < end[core]) &&
+          ((oldest_core < 0) ||
+           ((int)(entry.timestamp - oldest.timestamp) < 0))) {
+        oldest = entry;
+        oldest_core = core;
+      }
+    }
+    if (oldest_core < 0) {
+      break;
+    }
+    trace_print(&oldest);
+    next[oldest_core]++;
+  }
+}
@@ -0,0 +1,10 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+/* The parts of the xTIMEcomposer xc2compat.h used by the driver headers the
+ * host tests build
+ */
+#ifndef __xc2compat_h__
+#define __xc2compat_h__
+
+#define unsafe
+
+#endif // __xc2compat_h__
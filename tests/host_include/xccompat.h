@@ -0,0 +1,10 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+/* The parts of the xTIMEcomposer xccompat.h used by the driver headers the
+ * host tests build
+ */
+#ifndef __xccompat_h__
+#define __xccompat_h__
+
+#define REFERENCE_PARAM(type, name) type *name
+
+#endif // __xccompat_h__
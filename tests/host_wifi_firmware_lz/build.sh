@@ -0,0 +1,7 @@
+#!/bin/bash
+LZ_PATH=../../lib_wifi/src/broadcom_wiced/platform
+BUILD=build
+
+mkdir -p $BUILD
+
+gcc -g -x c $LZ_PATH/wwd_firmware_lz.c -x c++ main.cpp -I $LZ_PATH -o $BUILD/host
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+#include "wwd_firmware_lz.h"
+}
+
+/* Decompress a compressed firmware image in pieces of various sizes, as
+ * host_platform_resource_read_indirect() does, and check every byte against
+ * the original image.
+ *
+ * Usage: host <original> <compressed>
+ */
+
+static uint8_t *read_file(const char *path, size_t *size) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "Unable to open %s\n", path);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *data = (uint8_t *)malloc(*size ? *size : 1);
+  if (fread(data, 1, *size, f) != *size) {
+    fprintf(stderr, "Unable to read %s\n", path);
+    exit(1);
+  }
+  fclose(f);
+  return data;
+}
+
+static int check(const uint8_t *original, size_t original_size,
+                 const uint8_t *compressed, size_t compressed_size,
+                 size_t in_chunk, size_t out_chunk) {
+  static wifi_lz_t lz;
+  uint8_t *out = (uint8_t *)malloc(out_chunk);
+  size_t in_position = WIFI_LZ_HEADER_SIZE;
+  size_t out_position = 0;
+
+  wifi_lz_init(&lz);
+  while (out_position < original_size) {
+    size_t in_length = compressed_size - in_position;
+    if (in_length > in_chunk) {
+      in_length = in_chunk;
+    }
+    size_t out_length = original_size - out_position;
+    if (out_length > out_chunk) {
+      out_length = out_chunk;
+    }
+
+    size_t in_used;
+    size_t produced = wifi_lz_decompress(&lz, &compressed[in_position],
+                                         in_length, &in_used, out, out_length);
+    if ((produced == 0) && (in_used == 0)) {
+      printf("ERROR: compressed stream ended at %zu of %zu bytes\n",
+             out_position, original_size);
+      free(out);
+      return 1;
+    }
+    for (size_t i = 0; i < produced; i++) {
+      if (out[i] != original[out_position + i]) {
+        printf("ERROR: byte %zu is 0x%02x, expected 0x%02x "
+               "(input pieces %zu, output pieces %zu)\n",
+               out_position + i, out[i], original[out_position + i],
+               in_chunk, out_chunk);
+        free(out);
+        return 1;
+      }
+    }
+    in_position += in_used;
+    out_position += produced;
+  }
+  free(out);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <original> <compressed>\n", argv[0]);
+    return 1;
+  }
+
+  size_t original_size, compressed_size;
+  uint8_t *original = read_file(argv[1], &original_size);
+  uint8_t *compressed = read_file(argv[2], &compressed_size);
+
+  if ((compressed_size < WIFI_LZ_HEADER_SIZE) ||
+      (memcmp(compressed, WIFI_LZ_MAGIC, 4) != 0)) {
+    printf("ERROR: %s is not a compressed image\n", argv[2]);
+    return 1;
+  }
+  if (wifi_lz_image_size(compressed) != original_size) {
+    printf("ERROR: header gives size %u, expected %zu\n",
+           wifi_lz_image_size(compressed), original_size);
+    return 1;
+  }
+
+  const size_t in_chunks[] = {1, 7, 2048, compressed_size};
+  const size_t out_chunks[] = {1, 13, 1536, original_size ? original_size : 1};
+  int errors = 0;
+  for (size_t i = 0; i < sizeof(in_chunks) / sizeof(in_chunks[0]); i++) {
+    for (size_t j = 0; j < sizeof(out_chunks) / sizeof(out_chunks[0]); j++) {
+      errors += check(original, original_size, compressed, compressed_size,
+                      in_chunks[i], out_chunks[j]);
+    }
+  }
+
+  printf("%s: %zu bytes from %zu compressed: %s\n", argv[1], original_size,
+         compressed_size, errors ? "FAIL" : "PASS");
+  free(original);
+  free(compressed);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+#!/bin/bash
+# Compress test images and the WLAN firmware, and check that each one
+# decompresses to the original byte for byte.
+set -e
+
+COMPRESS=../../lib_wifi/compress_wifi_firmware.py
+FIRMWARE=../../lib_wifi/src/broadcom_wiced/sdk/WICED-SDK-3.3.1/resources/firmware/43362/43362A2.bin
+IMAGES=build/images
+
+./build.sh
+mkdir -p $IMAGES
+
+: > $IMAGES/empty.bin
+head -c 20000 /dev/urandom > $IMAGES/random.bin
+head -c 20000 /dev/zero > $IMAGES/zeros.bin
+yes "lib_wifi firmware test pattern" | head -c 50000 > $IMAGES/pattern.bin
+
+TESTS="$IMAGES/empty.bin $IMAGES/random.bin $IMAGES/zeros.bin $IMAGES/pattern.bin"
+if [ -f $FIRMWARE ]; then
+  cp $FIRMWARE $IMAGES/firmware.bin
+  TESTS="$TESTS $IMAGES/firmware.bin"
+fi
+
+for IMAGE in $TESTS; do
+  python $COMPRESS $IMAGE $IMAGE.z
+  build/host $IMAGE $IMAGE.z
+done
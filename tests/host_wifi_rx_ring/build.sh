@@ -0,0 +1,11 @@
+#!/bin/bash
+WIFI_PATH=../../lib_wifi
+BUILD=build
+
+mkdir -p $BUILD
+
+gcc -g -Wall -DWIFI_RX_RING_DEPTH=4 \
+  -DWIFI_RX_OVERFLOW_POLICY=WIFI_RX_STOP_READING \
+  -x c $WIFI_PATH/src/broadcom_wiced/network/xcore_rx_ring.c -x c++ main.cpp \
+  -I ../host_include -I $WIFI_PATH/api -I $WIFI_PATH/src/broadcom_wiced \
+  -I $WIFI_PATH/src/broadcom_wiced/network -o $BUILD/host
@@ -0,0 +1,163 @@
+#include <stdio.h>
+
+extern "C" {
+#include "xcore_rx_ring.h"
+#include "xcore_wwd_signals.h"
+#include "wifi_trace.h"
+}
+
+/* Check the RX ring with the WIFI_RX_STOP_READING overflow policy, in
+ * particular that a control request made while the ring is full has the bus
+ * read for its response: packets that do not fit are dropped, and reading only
+ * stops again once the request has finished.
+ *
+ * The WWD thread's side of the driver is stood in for by the functions below,
+ * which record whether reading is stopped and the resume signals sent.
+ */
+
+static int rx_paused;
+static int control_active;
+static unsigned resumes;
+static int failed;
+
+extern "C" {
+void xcore_wiced_set_rx_paused(int paused) {
+  rx_paused = paused;
+}
+
+int xcore_wiced_rx_paused() {
+  return rx_paused;
+}
+
+void xcore_wiced_set_control_active(int active) {
+  control_active = active;
+}
+
+int xcore_wiced_control_active() {
+  return control_active;
+}
+
+void xcore_wwd_send_control_signal(xcore_wwd_control_signal_t signal) {
+  if (signal == XCORE_WWD_RX_RESUME) {
+    resumes++;
+  }
+}
+
+void wifi_trace_record(wifi_trace_event_t event, uint32_t arg) {
+}
+}
+
+// Stand-ins for received packets, only ever compared
+static char packets[2 * WIFI_RX_RING_DEPTH];
+#define PACKET(n) ((struct pbuf *)&packets[n])
+
+static void check(int ok, const char *what) {
+  if (!ok) {
+    printf("ERROR: %s\n", what);
+    failed = 1;
+  }
+}
+
+static void check_state(xcore_rx_ring_t *ring, int paused, unsigned resumed,
+                        unsigned dropped, const char *when) {
+  wifi_rx_ring_stats_t stats;
+  xcore_rx_ring_get_stats(ring, &stats);
+  if (rx_paused != paused || resumes != resumed || stats.dropped != dropped) {
+    printf("ERROR: %s: reading %s, %u resumes, %u dropped "
+           "(expected %s, %u, %u)\n", when,
+           rx_paused ? "stopped" : "running", resumes, stats.dropped,
+           paused ? "stopped" : "running", resumed, dropped);
+    failed = 1;
+  }
+}
+
+static void fill(xcore_rx_ring_t *ring, unsigned first) {
+  for (unsigned i = 0; i < WIFI_RX_RING_DEPTH; i++) {
+    check(xcore_rx_ring_put(ring, PACKET(first + i), first + i) == NULL,
+          "packet dropped while filling the ring");
+  }
+}
+
+static void take_all(xcore_rx_ring_t *ring, unsigned first) {
+  for (unsigned i = 0; i < WIFI_RX_RING_DEPTH; i++) {
+    unsigned rx_time;
+    check(xcore_rx_ring_take(ring, &rx_time) == PACKET(first + i),
+          "packets taken out of order");
+    check(rx_time == first + i, "wrong time taken with packet");
+  }
+  check(xcore_rx_ring_is_empty(ring), "ring not empty");
+}
+
+/* The ring is full and reading stopped when a control request starts */
+static void test_control_while_full() {
+  xcore_rx_ring_t ring;
+  xcore_rx_ring_init(&ring);
+  resumes = 0;
+
+  fill(&ring, 0);
+  check_state(&ring, 1, 0, 0, "ring filled");
+
+  xcore_rx_ring_control_begin(&ring);
+  check_state(&ring, 0, 1, 0, "control request started");
+
+  // Packets read along with the control response do not fit
+  for (unsigned i = 0; i < WIFI_RX_RING_DEPTH; i++) {
+    struct pbuf *p = PACKET(WIFI_RX_RING_DEPTH + i);
+    check(xcore_rx_ring_put(&ring, p, 0) == p, "extra packet not dropped");
+  }
+  check_state(&ring, 0, 1, WIFI_RX_RING_DEPTH, "ring overflowed in request");
+
+  xcore_rx_ring_control_end(&ring);
+  check_state(&ring, 1, 1, WIFI_RX_RING_DEPTH, "control request finished");
+
+  // The packets queued before the request are still there, in order
+  take_all(&ring, 0);
+  check_state(&ring, 0, 2, WIFI_RX_RING_DEPTH, "ring emptied");
+
+  wifi_rx_ring_stats_t stats;
+  xcore_rx_ring_get_stats(&ring, &stats);
+  check(stats.paused == 2, "reading not stopped twice");
+  check(stats.high_water_mark == WIFI_RX_RING_DEPTH, "wrong high water mark");
+}
+
+/* The ring fills up during a control request */
+static void test_fill_during_control() {
+  xcore_rx_ring_t ring;
+  xcore_rx_ring_init(&ring);
+  resumes = 0;
+
+  xcore_rx_ring_control_begin(&ring);
+  check_state(&ring, 0, 0, 0, "control request started on empty ring");
+  fill(&ring, 0);
+  check_state(&ring, 0, 0, 0, "ring filled in request");
+
+  xcore_rx_ring_control_end(&ring);
+  check_state(&ring, 1, 0, 0, "control request finished");
+  take_all(&ring, 0);
+  check_state(&ring, 0, 1, 0, "ring emptied");
+}
+
+/* A control request with space in the ring leaves reading alone */
+static void test_control_with_space() {
+  xcore_rx_ring_t ring;
+  xcore_rx_ring_init(&ring);
+  resumes = 0;
+
+  check(xcore_rx_ring_put(&ring, PACKET(0), 0) == NULL, "packet dropped");
+  xcore_rx_ring_control_begin(&ring);
+  xcore_rx_ring_control_end(&ring);
+  check_state(&ring, 0, 0, 0, "control request with space");
+  check(!control_active, "control request still active");
+}
+
+int main() {
+  test_control_while_full();
+  test_fill_during_control();
+  test_control_with_space();
+
+  if (failed) {
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
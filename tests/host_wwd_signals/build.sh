@@ -0,0 +1,10 @@
+#!/bin/bash
+SIGNALS_PATH=../../lib_wifi/src/broadcom_wiced
+BUILD=build
+
+mkdir -p $BUILD
+
+# The host reorders stores and loads, so the signals need a full barrier
+gcc -g -O2 -pthread -DXCORE_WWD_SIGNALS_BARRIER=__sync_synchronize \
+  -x c $SIGNALS_PATH/xcore_wwd_signals.c -x c++ main.cpp \
+  -I ../host_include -I $SIGNALS_PATH -o $BUILD/host
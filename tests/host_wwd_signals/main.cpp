@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sched.h>
+
+extern "C" {
+#include "xcore_wwd_signals.h"
+}
+
+/* Stress the control signals between several producer threads and one
+ * consumer thread, as between the driver's logical cores and the one running
+ * the WWD thread. A pipe stands in for the notification channel end.
+ *
+ * Each producer owns one signal. It puts it and waits for the consumer to
+ * take it, so every put must be taken exactly once: a lost notification shows
+ * up as a producer timing out. The producers also all put the last signal,
+ * which must be coalesced.
+ *
+ * Usage: host [iterations]
+ */
+
+#define NUM_PRODUCERS (XCORE_WWD_NUM_SIGNALS - 1)
+#define SHARED_SIGNAL ((xcore_wwd_control_signal_t)(XCORE_WWD_NUM_SIGNALS - 1))
+#define TIMEOUT_NS 1000000000LL
+
+static signals_t signals;
+static int notification_pipe[2];
+static unsigned iterations = 100000;
+
+static volatile unsigned taken[XCORE_WWD_NUM_SIGNALS];
+static volatile unsigned shared_puts;
+static volatile unsigned notifications_sent;
+static volatile unsigned notifications_received;
+static volatile unsigned max_waiting;
+static volatile int stop;
+static volatile int failed;
+
+static long long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Yield now and then so that the threads interleave at every step, even on
+ * a host with one processor.
+ */
+static void maybe_yield(unsigned *seed) {
+  if ((rand_r(seed) & 7) == 0) {
+    sched_yield();
+  }
+}
+
+static void put(xcore_wwd_control_signal_t signal, unsigned *seed) {
+  if (signals_put(&signals, signal)) {
+    maybe_yield(seed);
+    unsigned sent = __sync_add_and_fetch(&notifications_sent, 1);
+    unsigned waiting = sent - notifications_received;
+    if (waiting > max_waiting) {
+      max_waiting = waiting;
+    }
+    char notification = 0;
+    if (write(notification_pipe[1], &notification, 1) != 1) {
+      fprintf(stderr, "Unable to write notification\n");
+      exit(1);
+    }
+  }
+}
+
+static void *producer(void *arg) {
+  xcore_wwd_control_signal_t signal = (xcore_wwd_control_signal_t)(size_t)arg;
+  unsigned seed = signal;
+
+  for (unsigned i = 0; i < iterations && !failed; i++) {
+    unsigned before = taken[signal];
+    put(signal, &seed);
+    if (i & 1) {
+      __sync_add_and_fetch(&shared_puts, 1);
+      put(SHARED_SIGNAL, &seed);
+    }
+
+    long long timeout = now_ns() + TIMEOUT_NS;
+    while (taken[signal] == before) {
+      if (now_ns() > timeout) {
+        printf("ERROR: signal %d put %u not taken\n", signal, i);
+        failed = 1;
+        return NULL;
+      }
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static void *consumer(void *) {
+  char notification;
+  unsigned seed = NUM_PRODUCERS;
+
+  while (read(notification_pipe[0], &notification, 1) == 1) {
+    __sync_add_and_fetch(&notifications_received, 1);
+
+    // Discard the notifications of producers which raced, as
+    // xcore_wwd_handle_signals() does
+    int flags = fcntl(notification_pipe[0], F_GETFL);
+    fcntl(notification_pipe[0], F_SETFL, flags | O_NONBLOCK);
+    while (read(notification_pipe[0], &notification, 1) == 1) {
+      __sync_add_and_fetch(&notifications_received, 1);
+    }
+    fcntl(notification_pipe[0], F_SETFL, flags);
+
+    maybe_yield(&seed);
+    signals_notified(&signals);
+    for (unsigned i = 0; i < XCORE_WWD_NUM_SIGNALS; i++) {
+      maybe_yield(&seed);
+      if (signals_take(&signals, (xcore_wwd_control_signal_t)i)) {
+        __sync_add_and_fetch(&taken[i], 1);
+      }
+    }
+
+    if (stop) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    iterations = atoi(argv[1]);
+  }
+  if (pipe(notification_pipe) != 0) {
+    fprintf(stderr, "Unable to create notification pipe\n");
+    return 1;
+  }
+  signals_clear(&signals);
+
+  pthread_t consumer_thread;
+  pthread_t producer_threads[NUM_PRODUCERS];
+  pthread_create(&consumer_thread, NULL, consumer, NULL);
+  for (size_t i = 0; i < NUM_PRODUCERS; i++) {
+    pthread_create(&producer_threads[i], NULL, producer, (void *)i);
+  }
+  for (size_t i = 0; i < NUM_PRODUCERS; i++) {
+    pthread_join(producer_threads[i], NULL);
+  }
+
+  // Wake the consumer for a last pass over the signals
+  stop = 1;
+  char notification = 0;
+  if (write(notification_pipe[1], &notification, 1) != 1) {
+    fprintf(stderr, "Unable to write notification\n");
+    return 1;
+  }
+  pthread_join(consumer_thread, NULL);
+
+  for (unsigned i = 0; i < NUM_PRODUCERS; i++) {
+    if (taken[i] != iterations) {
+      printf("ERROR: signal %u put %u times but taken %u times\n",
+             i, iterations, taken[i]);
+      failed = 1;
+    }
+  }
+  if ((taken[SHARED_SIGNAL] == 0) || (taken[SHARED_SIGNAL] > shared_puts)) {
+    printf("ERROR: shared signal put %u times but taken %u times\n",
+           shared_puts, taken[SHARED_SIGNAL]);
+    failed = 1;
+  }
+  if (max_waiting > NUM_PRODUCERS) {
+    printf("ERROR: %u notifications waiting at once\n", max_waiting);
+    failed = 1;
+  }
+
+  printf("%u producers, %u puts each: shared signal taken %u of %u times, "
+         "%u notifications, at most %u waiting\n",
+         NUM_PRODUCERS, iterations, taken[SHARED_SIGNAL], shared_puts,
+         notifications_sent, max_waiting);
+  if (failed) {
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
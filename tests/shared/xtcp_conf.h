@@ -0,0 +1,7 @@
+// Copyright (c) 2016, XMOS Ltd, All rights reserved
+#ifndef __xtcp_conf_h__
+#define __xtcp_conf_h__
+
+#include "wifi_conf_derived.h"
+
+#endif // __xtcp_conf_h__
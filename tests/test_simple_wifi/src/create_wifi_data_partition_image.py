@@ -1,6 +1,7 @@
 #!/usr/bin/env python
 import os.path
 import subprocess
+import sys
 
 
 if __name__ == "__main__":
@@ -15,11 +16,34 @@ if __name__ == "__main__":
 
     output_image_path = os.path.join('..', 'wifi_bcm_43362A2')
 
+    # Empty connection profile, written by lib_wifi after each join
+    profile_path = os.path.join('..', 'WIFI.PRF')
+    profile_size = 64
+
     test_xe_path = os.path.join('..', 'bin', 'test_simple_wifi.xe')
 
+    src_path = os.path.dirname(os.path.realpath(__file__))
+
+    # With --compress the firmware is stored compressed, under the same name
+    if '--compress' in sys.argv[1:]:
+        compress_path = os.path.join('..', '..', '..', '..', 'lib_wifi',
+                                     'lib_wifi', 'compress_wifi_firmware.py')
+        compressed_dir = os.path.join('..', 'compressed')
+        if not os.path.isdir(os.path.join(src_path, compressed_dir)):
+            os.mkdir(os.path.join(src_path, compressed_dir))
+        compressed_path = os.path.join(compressed_dir,
+                                       os.path.basename(bcm_firmware_path))
+        subprocess.check_call([sys.executable, compress_path,
+                               bcm_firmware_path, compressed_path],
+                              cwd=src_path)
+        bcm_firmware_path = compressed_path
+
+    with open(os.path.join(src_path, profile_path), 'wb') as f:
+        f.write(b'\0' * profile_size)
+
     # Run image builder
     subprocess.check_call([image_creator_path, output_image_path,
-                           bcm_firmware_path],
+                           bcm_firmware_path, profile_path],
                            cwd=os.path.dirname(os.path.realpath(__file__)))
 
     # Run xflash to write FAT image to data partition of flash
@@ -0,0 +1,2 @@
+#!/bin/bash
+xsim bin/test_wifi_netif_latency.xe
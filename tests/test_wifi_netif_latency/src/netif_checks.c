@@ -0,0 +1,64 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include "wifi_broadcom_wiced.h"
+#include "xcore_netif_queue.h"
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+#include <print.h>
+
+/* Checks of the netif's linkoutput, which cannot be called from xC. Neither
+ * check reaches the WWD driver: a packet is only passed to it once there is
+ * room in the TX queue and it is not already queued.
+ */
+int check_linkoutput() {
+  struct netif netif;
+  struct pbuf *queued[WIFI_TX_QUEUE_DEPTH];
+  int ok = 1;
+
+  xcore_netif_queue_attach(&netif);
+
+  // Fill the TX queue as if the WLAN had no SDPCM credits
+  for (unsigned i = 0; i < WIFI_TX_QUEUE_DEPTH; i++) {
+    queued[i] = pbuf_alloc(PBUF_RAW, 64, PBUF_RAM);
+    if (xcore_wiced_tx_queue_reserve(queued[i]) != XCORE_WICED_TX_RESERVED) {
+      printstrln("ERROR: TX queue full too soon");
+      ok = 0;
+    }
+  }
+
+  // A further packet is refused so that TCP retransmits it later
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, 64, PBUF_RAM);
+  wifi_stats_t stats;
+  xcore_wiced_stats_get(&stats);
+  unsigned drops = stats.tx_queue_drops;
+  if (netif.linkoutput(&netif, p) != ERR_MEM) {
+    printstrln("ERROR: packet accepted with TX queue full");
+    ok = 0;
+  }
+  xcore_wiced_stats_get(&stats);
+  if (stats.tx_queue_drops != drops + 1) {
+    printstrln("ERROR: TX queue drop not counted");
+    ok = 0;
+  }
+  pbuf_free(p);
+
+  // A retransmission of a packet still queued is not sent again
+  unsigned ref = queued[0]->ref;
+  if (netif.linkoutput(&netif, queued[0]) != ERR_OK) {
+    printstrln("ERROR: queued packet refused");
+    ok = 0;
+  }
+  if (queued[0]->ref != ref) {
+    printstrln("ERROR: queued packet sent again");
+    ok = 0;
+  }
+
+  for (unsigned i = 0; i < WIFI_TX_QUEUE_DEPTH; i++) {
+    xcore_wiced_tx_queue_release(queued[i]);
+    pbuf_free(queued[i]);
+  }
+  if (wifi_tx_queue_full()) {
+    printstrln("ERROR: TX queue still full");
+    ok = 0;
+  }
+  return ok;
+}
@@ -0,0 +1,5 @@
+#!/bin/bash
+# Run the benchmark with MOSI (XS1_PORT_1L) looped back to MISO (XS1_PORT_1M)
+xsim bin/test_wifi_spi_benchmark.xe \
+ --plugin LoopbackPort.dll \
+ '-port tile[1] XS1_PORT_1L 1 0 -port tile[1] XS1_PORT_1M 1 0'
@@ -0,0 +1,6 @@
+#!/bin/bash
+# Run the benchmark with the WLAN IRQ (XS1_PORT_1M) looped back to the WWD
+# thread's IRQ input (XS1_PORT_1N)
+xsim bin/test_wwd_poll_benchmark.xe \
+ --plugin LoopbackPort.dll \
+ '-port tile[0] XS1_PORT_1M 1 0 -port tile[0] XS1_PORT_1N 1 0'
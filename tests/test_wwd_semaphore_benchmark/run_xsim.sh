@@ -0,0 +1,3 @@
+#!/bin/bash
+# Run the semaphore benchmark, which needs no plugins
+xsim bin/test_wwd_semaphore_benchmark.xe
@@ -0,0 +1,45 @@
+// Copyright (c) 2017, XMOS Ltd, All rights reserved
+#include <timer.h>
+
+/* The WWD RTOS semaphores that the event-driven ones replaced, kept here as
+ * the baseline for the benchmark. Every operation takes newlib's hardware
+ * lock and a waiter polls the count once a microsecond.
+ */
+extern unsigned __libc_hwlock;
+
+static inline void hwlock_acquire()
+{
+  __asm__ __volatile__ ("in %0, res[%0]"
+                        : /* no output */
+                        : "r" (__libc_hwlock)
+                        : "memory");
+}
+
+static inline void hwlock_release()
+{
+  __asm__ __volatile__ ("out res[%0], %0"
+                        : /* no output */
+                        : "r" (__libc_hwlock)
+                        : "memory");
+}
+
+void spin_semaphore_set(unsigned char* semaphore) {
+  hwlock_acquire();
+  if (*semaphore < 255) {
+    *semaphore += 1;
+  }
+  hwlock_release();
+}
+
+void spin_semaphore_get(unsigned char* semaphore) {
+  while (1) {
+    hwlock_acquire();
+    if (*semaphore > 0) {
+      *semaphore -= 1;
+      hwlock_release();
+      return;
+    }
+    hwlock_release();
+    delay_microseconds(1); // Yield processing power
+  }
+}